@@ -0,0 +1,177 @@
+#include "../src/impl/osu_api.hh"
+
+#include <json/json.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Compares decoding of `/api/get_beatmaps` response by osu_api::parseBeatmaps against jsoncpp tree with stoi/stof conversions it replaced.
+// Both paths build the same JSON that /b/ and /s/ respond with, for every difficulty of response.
+// Usage: hanaru_osu_api_bench [response.json] [iterations]
+
+namespace detail {
+
+    using Clock = std::chrono::steady_clock;
+
+    // Copy of downloader::serializeBeatmap before typed decoding, fields are taken from JSON tree as strings
+    Json::Value serializeTree(const Json::Value& json) {
+        std::string maxCombo = "0";
+
+        if (json["max_combo"].isString()) {
+            maxCombo = json["max_combo"].asString();
+        }
+
+        Json::Value beatmap;
+
+        beatmap["beatmap_id"]       = std::stoi(json["beatmap_id"].asString());
+        beatmap["beatmapset_id"]    = std::stoi(json["beatmapset_id"].asString());
+        beatmap["beatmap_md5"]      = json["file_md5"].asString();
+        beatmap["artist"]           = json["artist"].asString();
+        beatmap["title"]            = json["title"].asString();
+        beatmap["version"]          = json["version"].asString();
+        beatmap["creator"]          = json["creator"].asString();
+        beatmap["count_normal"]     = std::stoi(json["count_normal"].asString());
+        beatmap["count_slider"]     = std::stoi(json["count_slider"].asString());
+        beatmap["count_spinner"]    = std::stoi(json["count_spinner"].asString());
+        beatmap["max_combo"]        = std::stoi(maxCombo);
+        beatmap["ranked_status"]    = std::stoi(json["approved"].asString());
+        beatmap["latest_update"]    = json["last_update"].asString();
+        beatmap["bpm"]              = std::stoi(json["bpm"].asString());
+        beatmap["hit_length"]       = std::stoi(json["hit_length"].asString());
+
+        beatmap["difficulty"] = std::stof(json["difficultyrating"].asString());
+
+        beatmap["cs"] = std::stof(json["diff_size"].asString());
+        beatmap["ar"] = std::stof(json["diff_approach"].asString());
+        beatmap["od"] = std::stof(json["diff_overall"].asString());
+        beatmap["hp"] = std::stof(json["diff_drain"].asString());
+        beatmap["mode"] = std::stoi(json["mode"].asString());
+
+        return beatmap;
+    }
+
+    // Same as downloader::serializeBeatmap, which cannot be linked without the rest of downloader
+    Json::Value serializeTyped(const hanaru::ApiBeatmap& beatmap) {
+        Json::Value json;
+
+        json["beatmap_id"]       = beatmap.beatmapId;
+        json["beatmapset_id"]    = beatmap.beatmapsetId;
+        json["beatmap_md5"]      = beatmap.md5;
+        json["artist"]           = beatmap.artist;
+        json["title"]            = beatmap.title;
+        json["version"]          = beatmap.version;
+        json["creator"]          = beatmap.creator;
+        json["count_normal"]     = beatmap.countNormal;
+        json["count_slider"]     = beatmap.countSlider;
+        json["count_spinner"]    = beatmap.countSpinner;
+        json["max_combo"]        = beatmap.maxCombo;
+        json["ranked_status"]    = beatmap.rankedStatus;
+        json["latest_update"]    = beatmap.lastUpdate;
+        json["bpm"]              = static_cast<int32_t>(beatmap.bpm);
+        json["hit_length"]       = beatmap.hitLength;
+
+        json["difficulty"] = beatmap.difficulty;
+
+        json["cs"] = beatmap.cs;
+        json["ar"] = beatmap.ar;
+        json["od"] = beatmap.od;
+        json["hp"] = beatmap.hp;
+        json["mode"] = beatmap.mode;
+
+        return json;
+    }
+
+    bool parseTree(const std::string& body, Json::Value& root) {
+        Json::CharReaderBuilder builder {};
+        std::unique_ptr<Json::CharReader> reader { builder.newCharReader() };
+
+        return reader->parse(body.data(), body.data() + body.size(), &root, nullptr) && root.isArray();
+    }
+
+    size_t decodeTree(const std::string& body) {
+        Json::Value root {};
+        if (!parseTree(body, root)) {
+            return 0;
+        }
+
+        Json::Value response { Json::arrayValue };
+        for (const Json::Value& json : root) {
+            response.append(serializeTree(json));
+        }
+
+        return response.size();
+    }
+
+    size_t decodeTyped(const std::string& body) {
+        const auto beatmaps = hanaru::osu_api::parseBeatmaps(body);
+        if (!beatmaps.has_value()) {
+            return 0;
+        }
+
+        Json::Value response { Json::arrayValue };
+        for (const hanaru::ApiBeatmap& beatmap : beatmaps.value()) {
+            response.append(serializeTyped(beatmap));
+        }
+
+        return response.size();
+    }
+
+    // Median time of single call in microseconds, `rows` receives amount of difficulties returned by last call
+    double measure(const std::function<size_t()>& callback, size_t iterations, size_t& rows) {
+        std::vector<double> samples {};
+        samples.reserve(iterations);
+
+        for (size_t i = 0; i < iterations; i++) {
+            const Clock::time_point start = Clock::now();
+            rows = callback();
+            samples.push_back(std::chrono::duration<double, std::micro>(Clock::now() - start).count());
+        }
+
+        std::sort(samples.begin(), samples.end());
+        return samples[samples.size() / 2];
+    }
+
+    void report(const char* name, const std::function<size_t()>& callback, size_t iterations) {
+        size_t rows = 0;
+        const double median = measure(callback, iterations, rows);
+
+        printf("%-28s %10.1f us  %zu rows\n", name, median, rows);
+    }
+
+}
+
+int main(int argc, char** argv) {
+    const std::string path = argc > 1 ? argv[1] : HANARU_BENCH_FIXTURE;
+    const size_t iterations = argc > 2 ? std::stoul(argv[2]) : 1000;
+
+    std::ifstream file { path, std::ios::binary };
+    if (!file.is_open()) {
+        fprintf(stderr, "cannot open %s\n", path.c_str());
+        return 1;
+    }
+
+    const std::string body { std::istreambuf_iterator<char> { file }, std::istreambuf_iterator<char> {} };
+    printf("%s: %zu bytes, %zu iterations, median per response\n", path.c_str(), body.size(), iterations);
+
+    detail::report("parse (jsoncpp)", [&body]() {
+        Json::Value root {};
+        return detail::parseTree(body, root) ? static_cast<size_t>(root.size()) : 0;
+    }, iterations);
+
+    detail::report("parse (parseBeatmaps)", [&body]() {
+        const auto beatmaps = hanaru::osu_api::parseBeatmaps(body);
+        return beatmaps.has_value() ? beatmaps->size() : 0;
+    }, iterations);
+
+    detail::report("serialize (jsoncpp + stoi)", [&body]() { return detail::decodeTree(body); }, iterations);
+    detail::report("serialize (parseBeatmaps)", [&body]() { return detail::decodeTyped(body); }, iterations);
+
+    return 0;
+}
@@ -32,13 +32,49 @@ CREATE TABLE IF NOT EXISTS `beatmaps` (
     `latest_update` bigint NOT NULL DEFAULT '0',
     `ranked_status_freezed` tinyint NOT NULL DEFAULT '0',
     `creating_date` bigint NOT NULL DEFAULT '0',
-    PRIMARY KEY (`id`)
+    `checked_at` bigint NOT NULL DEFAULT '0',
+    PRIMARY KEY (`id`),
+    UNIQUE KEY `beatmap_id` (`beatmap_id`),
+    KEY `beatmapset_id` (`beatmapset_id`),
+    KEY `ranked_status_checked_at` (`ranked_status`, `checked_at`)
 ) ENGINE=InnoDB AUTO_INCREMENT=0 DEFAULT CHARSET=utf8;
 
 CREATE TABLE IF NOT EXISTS `beatmaps_names` (
     `id` int NOT NULL UNIQUE,
-    `name` text NOT NULL
+    `name` text NOT NULL,
+    `latest_update` bigint NOT NULL DEFAULT '0',
+    `ranked_status` tinyint NOT NULL DEFAULT '-3',
+    `checked_at` bigint NOT NULL DEFAULT '0'
 ) ENGINE=InnoDB CHARSET=utf8;
 
+-- .osu files of single difficulties, compressed rows keep thousands of small text files compact
+CREATE TABLE IF NOT EXISTS `osu_files` (
+    `beatmap_id` int NOT NULL,
+    `md5` varchar(32) NOT NULL DEFAULT '',
+    `content` mediumblob NOT NULL,
+    PRIMARY KEY (`beatmap_id`)
+) ENGINE=InnoDB ROW_FORMAT=COMPRESSED;
+
+CREATE TABLE IF NOT EXISTS `hanaru_state` (
+    `name` varchar(64) NOT NULL,
+    `value` text NOT NULL,
+    PRIMARY KEY (`name`)
+) ENGINE=InnoDB CHARSET=utf8;
+
+-- If you are upgrading from previous version, apply this manually
+-- ALTER TABLE `beatmaps_names`
+--     ADD COLUMN `latest_update` bigint NOT NULL DEFAULT '0',
+--     ADD COLUMN `ranked_status` tinyint NOT NULL DEFAULT '-3',
+--     ADD COLUMN `checked_at` bigint NOT NULL DEFAULT '0';
+-- Older versions could store the same difficulty several times, duplicates must be removed before unique key is added (the newest row is kept)
+-- DELETE older FROM `beatmaps` older
+--     JOIN `beatmaps` newer ON newer.`beatmap_id` = older.`beatmap_id` AND newer.`id` > older.`id`;
+-- ALTER TABLE `beatmaps`
+--     ADD UNIQUE KEY `beatmap_id` (`beatmap_id`),
+--     ADD KEY `beatmapset_id` (`beatmapset_id`);
+-- ALTER TABLE `beatmaps`
+--     ADD COLUMN `checked_at` bigint NOT NULL DEFAULT '0',
+--     ADD KEY `ranked_status_checked_at` (`ranked_status`, `checked_at`);
+
 -- Re-enables warning
 SET sql_notes = 1;
\ No newline at end of file
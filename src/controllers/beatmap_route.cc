@@ -1,7 +1,9 @@
 #include "beatmap_route.hh"
 
-#include "../impl/utils.hh"
+#include "../impl/cancellation.hh"
 #include "../impl/downloader.hh"
+#include "../impl/prefetcher.hh"
+#include "../impl/utils.hh"
 
 void BeatmapRoute::get(const HttpRequestPtr& req, std::function<void(const HttpResponsePtr&)>&& callback, int64_t id) {
     if (!hanaru::verifyRateLimit(1)) {
@@ -13,13 +15,21 @@ void BeatmapRoute::get(const HttpRequestPtr& req, std::function<void(const HttpR
         return;
     }
 
+    // Client receives 504 if database or osu! is too slow
+    callback = hanaru::Cancellation { req }.withDeadline(std::move(callback), hanaru::deadlines::lookup());
+
     drogon::orm::DbClientPtr db = app().getDbClient();
     db->execSqlAsync(
         "SELECT * FROM beatmaps WHERE beatmap_id = ? LIMIT 1;",
         [id, callback](const drogon::orm::Result& result) mutable {
             Json::Value beatmap = Json::objectValue;
 
-            if (result.empty()) {
+            // Rows that were taken from .osu files lack status and star rating, so osu! API is asked about them when it's available
+            const bool incomplete = !result.empty()
+                && result.front()["ranked_status"].as<int32_t>() == static_cast<int32_t>(hanaru::RankedStatus::Unknown)
+                && hanaru::downloader::hasApiKeys();
+
+            if (result.empty() || incomplete) {
                 if (!hanaru::verifyRateLimit(10)) {
                     HttpResponsePtr response = HttpResponse::newHttpResponse();
                     response->setStatusCode(k429TooManyRequests);
@@ -30,6 +40,10 @@ void BeatmapRoute::get(const HttpRequestPtr& req, std::function<void(const HttpR
                 }
 
                 hanaru::downloader::downloadBeatmap(id, [callback = std::move(callback)](const std::tuple<Json::Value, HttpStatusCode>& result) {
+                    if (std::get<HttpStatusCode>(result) == k200OK && std::get<Json::Value>(result)["beatmapset_id"].isIntegral()) {
+                        hanaru::prefetcher::notifyLookup(std::get<Json::Value>(result)["beatmapset_id"].asInt64());
+                    }
+
                     HttpResponsePtr response = HttpResponse::newHttpJsonResponse(std::get<Json::Value>(result));
                     response->setStatusCode(std::get<HttpStatusCode>(result));
                     callback(response);
@@ -85,6 +99,7 @@ void BeatmapRoute::get(const HttpRequestPtr& req, std::function<void(const HttpR
             beatmap["hp"] = row["hp"].as<float>();
             beatmap["mode"] = mode;
 
+            hanaru::prefetcher::notifyLookup(row["beatmapset_id"].as<int64_t>());
             callback(HttpResponse::newHttpJsonResponse(std::move(beatmap)));
         }, 
         [callback](const drogon::orm::DrogonDbException&) {
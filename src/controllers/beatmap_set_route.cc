@@ -1,6 +1,8 @@
 #include "beatmap_set_route.hh"
 
+#include "../impl/cancellation.hh"
 #include "../impl/downloader.hh"
+#include "../impl/prefetcher.hh"
 #include "../impl/utils.hh"
 
 void BeatmapSetRoute::get(const HttpRequestPtr& req, std::function<void(const HttpResponsePtr&)>&& callback, int64_t id) {
@@ -13,11 +15,19 @@ void BeatmapSetRoute::get(const HttpRequestPtr& req, std::function<void(const Ht
         return;
     }
 
+    // Client receives 504 if database or osu! is too slow
+    callback = hanaru::Cancellation { req }.withDeadline(std::move(callback), hanaru::deadlines::lookup());
+
     drogon::orm::DbClientPtr db = app().getDbClient();
     db->execSqlAsync(
         "SELECT * FROM beatmaps WHERE beatmapset_id = ?;",
         [id, callback](const drogon::orm::Result& result) mutable {
-            if (result.empty()) {
+            // Rows that were taken from .osu files lack status and star rating, so osu! API is asked about them when it's available
+            const bool incomplete = !result.empty()
+                && result.front()["ranked_status"].as<int32_t>() == static_cast<int32_t>(hanaru::RankedStatus::Unknown)
+                && hanaru::downloader::hasApiKeys();
+
+            if (result.empty() || incomplete) {
                 if (!hanaru::verifyRateLimit(10)) {
                     HttpResponsePtr response = HttpResponse::newHttpResponse();
                     response->setStatusCode(k429TooManyRequests);
@@ -27,7 +37,11 @@ void BeatmapSetRoute::get(const HttpRequestPtr& req, std::function<void(const Ht
                     return;
                 }
 
-                hanaru::downloader::downloadBeatmapset(id, [callback = std::move(callback)](const std::tuple<Json::Value, HttpStatusCode>& result) {
+                hanaru::downloader::downloadBeatmapset(id, [id, callback = std::move(callback)](const std::tuple<Json::Value, HttpStatusCode>& result) {
+                    if (std::get<HttpStatusCode>(result) == k200OK && !std::get<Json::Value>(result).empty()) {
+                        hanaru::prefetcher::notifyLookup(id);
+                    }
+
                     HttpResponsePtr response = HttpResponse::newHttpJsonResponse(std::get<Json::Value>(result));
                     response->setStatusCode(std::get<HttpStatusCode>(result));
                     callback(response);
@@ -89,6 +103,7 @@ void BeatmapSetRoute::get(const HttpRequestPtr& req, std::function<void(const Ht
                 beatmaps.append(beatmap);
             }
 
+            hanaru::prefetcher::notifyLookup(id);
             callback(HttpResponse::newHttpJsonResponse(std::move(beatmaps)));
         },
         [callback](const drogon::orm::DrogonDbException&) {
@@ -1,21 +1,264 @@
 #include "download_route.hh"
 
+#include "../impl/cancellation.hh"
 #include "../impl/downloader.hh"
+#include "../impl/prefetcher.hh"
+#include "../impl/repacker.hh"
 #include "../impl/utils.hh"
 
-void DownloadRoute::get(const HttpRequestPtr& req, std::function<void(const HttpResponsePtr&)>&& callback, int64_t id) {
-    hanaru::downloader::downloadMap(id, [callback = std::move(callback)](std::tuple<HttpStatusCode, std::string, std::string>&& result) {
+#include <trantor/net/TcpConnection.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <optional>
+#include <string_view>
+
+namespace detail {
+
+    HttpResponsePtr downloadError(HttpStatusCode code, std::string&& message) {
         HttpResponsePtr response = HttpResponse::newHttpResponse();
         response->setContentTypeCode(drogon::CT_TEXT_PLAIN);
-        response->setStatusCode(std::get<HttpStatusCode>(result));
-        response->setBody(std::move(std::get<2>(result)));
+        response->setStatusCode(code);
+        response->setBody(std::move(message));
+        return response;
+    }
+
+    std::string contentTypeFromName(const std::string& name) {
+        const size_t dot = name.rfind('.');
+        if (dot == std::string::npos) {
+            return "application/octet-stream";
+        }
+
+        std::string extension = name.substr(dot + 1);
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return std::tolower(c); });
+
+        if (extension == "osu" || extension == "osb" || extension == "txt") {
+            return "text/plain; charset=utf-8";
+        }
+
+        if (extension == "jpg" || extension == "jpeg") {
+            return "image/jpeg";
+        }
+
+        if (extension == "png") {
+            return "image/png";
+        }
+
+        if (extension == "mp3") {
+            return "audio/mpeg";
+        }
+
+        if (extension == "ogg") {
+            return "audio/ogg";
+        }
+
+        if (extension == "wav") {
+            return "audio/wav";
+        }
+
+        return "application/octet-stream";
+    }
+
+    std::string_view trim(std::string_view str) {
+        while (!str.empty() && std::isspace(static_cast<unsigned char>(str.front()))) {
+            str.remove_prefix(1);
+        }
+
+        while (!str.empty() && std::isspace(static_cast<unsigned char>(str.back()))) {
+            str.remove_suffix(1);
+        }
+
+        return str;
+    }
+
+    // Coding is acceptable if it's listed (or covered by `*`) with non-zero q-value, explicit entry wins over `*`
+    bool acceptsGzip(const std::string& header) {
+        std::optional<bool> gzip {};
+        std::optional<bool> wildcard {};
+
+        std::string_view rest = header;
+        while (!rest.empty()) {
+            const size_t comma = rest.find(',');
+            const std::string_view item = rest.substr(0, comma);
+            rest = comma == std::string_view::npos ? std::string_view {} : rest.substr(comma + 1);
+
+            const size_t semicolon = item.find(';');
+            std::string coding { trim(item.substr(0, semicolon)) };
+            std::transform(coding.begin(), coding.end(), coding.begin(), [](unsigned char c) { return std::tolower(c); });
+
+            double quality = 1.0;
+            std::string_view parameters = semicolon == std::string_view::npos ? std::string_view {} : item.substr(semicolon + 1);
+            while (!parameters.empty()) {
+                const size_t next = parameters.find(';');
+                const std::string_view parameter = trim(parameters.substr(0, next));
+                parameters = next == std::string_view::npos ? std::string_view {} : parameters.substr(next + 1);
+
+                if (parameter.size() > 2 && (parameter[0] == 'q' || parameter[0] == 'Q') && parameter[1] == '=') {
+                    quality = std::atof(std::string { parameter.substr(2) }.c_str());
+                }
+            }
+
+            if (coding == "gzip" || coding == "x-gzip") {
+                gzip = quality > 0.0;
+            }
+            else if (coding == "*") {
+                wildcard = quality > 0.0;
+            }
+        }
+
+        return gzip.value_or(wildcard.value_or(false));
+    }
+
+}
+
+void DownloadRoute::get(const HttpRequestPtr& req, std::function<void(const HttpResponsePtr&)>&& callback, int64_t id) {
+    // Deadline is over once archive starts to be sent, so slow clients can still receive whole archive
+    hanaru::Cancellation cancellation { req };
+    callback = cancellation.withDeadline(std::move(callback), hanaru::deadlines::download());
+
+    hanaru::prefetcher::notifyDownload(id);
 
-        if (response->getStatusCode() == k200OK) {
-            response->setContentTypeCodeAndCustomString(drogon::CT_CUSTOM, "application/x-osu-beatmap-archive");
-            response->addHeader("Content-Disposition", "attachment; filename=\"" + std::move(std::get<1>(result)) + "\"");
+    auto sendArchive = [callback](std::tuple<HttpStatusCode, std::shared_ptr<const hanaru::Beatmap>, std::string>&& result) {
+        auto& [code, beatmap, error] = result;
+
+        if (beatmap == nullptr) {
+            callback(detail::downloadError(code, std::move(error)));
+            return;
         }
 
+        HttpResponsePtr response = HttpResponse::newHttpResponse();
+        response->setStatusCode(code);
+        response->setBody(beatmap->content());
+        response->setContentTypeCodeAndCustomString(drogon::CT_CUSTOM, "application/x-osu-beatmap-archive");
+        response->addHeader("Content-Disposition", "attachment; filename=\"" + beatmap->name() + "\"");
+
         callback(response);
-    });
+    };
+
+    if (req->getParameter("lite") == "1") {
+        hanaru::repacker::downloadLiteMap(id, std::move(sendArchive));
+        return;
+    }
+
+    // Archive is sent while it's being downloaded from osu!, so client doesn't wait for whole transfer
+    auto streamArchive = [callback = std::move(callback), weakConnection = req->getConnectionPtr()](std::shared_ptr<hanaru::MapStream> stream) {
+        const std::string filename = stream->name();
+
+        HttpResponsePtr response = HttpResponse::newAsyncStreamResponse([stream = std::move(stream), weakConnection](ResponseStreamPtr responseStream) {
+            std::shared_ptr<trantor::TcpConnection> connection = weakConnection.lock();
+            if (connection == nullptr) {
+                return;
+            }
+
+            std::shared_ptr<ResponseStream> sharedStream = std::move(responseStream);
+            auto handed = std::make_shared<size_t>(0);
+            const size_t sentBefore = connection->bytesSent();
+
+            stream->subscribe(
+                connection->getLoop(),
+                [sharedStream, handed](std::string_view chunk) {
+                    *handed += chunk.size();
+                    return sharedStream->send(std::string { chunk });
+                },
+                [weakConnection, handed, sentBefore]() -> size_t {
+                    std::shared_ptr<trantor::TcpConnection> connection = weakConnection.lock();
+                    if (connection == nullptr) {
+                        return 0;
+                    }
+
+                    const size_t received = connection->bytesSent() - sentBefore;
+                    return *handed > received ? *handed - received : 0;
+                },
+                [sharedStream, weakConnection](bool success) {
+                    if (success) {
+                        sharedStream->close();
+                        return;
+                    }
+
+                    // Chunked body without last chunk tells client that archive is truncated, closing it normally would look like complete download
+                    if (std::shared_ptr<trantor::TcpConnection> connection = weakConnection.lock()) {
+                        connection->forceClose();
+                    }
+                }
+            );
+        });
+        response->setContentTypeCodeAndCustomString(drogon::CT_CUSTOM, "application/x-osu-beatmap-archive");
+        response->addHeader("Content-Disposition", "attachment; filename=\"" + filename + "\"");
+
+        callback(response);
+    };
+
+    hanaru::downloader::downloadMap(id, std::move(sendArchive), std::move(streamArchive), std::move(cancellation));
+}
+
+void DownloadRoute::files(const HttpRequestPtr& req, std::function<void(const HttpResponsePtr&)>&& callback, int64_t id) {
+    hanaru::Cancellation cancellation { req };
+    callback = cancellation.withDeadline(std::move(callback), hanaru::deadlines::download());
+
+    hanaru::downloader::downloadMap(id, [callback = std::move(callback)](std::tuple<HttpStatusCode, std::shared_ptr<const hanaru::Beatmap>, std::string>&& result) {
+        auto& [code, beatmap, error] = result;
+
+        if (beatmap == nullptr) {
+            callback(detail::downloadError(code, std::move(error)));
+            return;
+        }
+
+        Json::Value files = Json::arrayValue;
+        for (const hanaru::ZipEntry& entry : beatmap->entries()) {
+            Json::Value file;
+
+            file["name"] = entry.name;
+            file["size"] = entry.uncompressedSize;
+            file["compressed_size"] = entry.compressedSize;
+            file["crc32"] = entry.crc32;
+
+            files.append(std::move(file));
+        }
+
+        callback(HttpResponse::newHttpJsonResponse(std::move(files)));
+    }, nullptr, std::move(cancellation));
 }
 
+void DownloadRoute::file(const HttpRequestPtr& req, std::function<void(const HttpResponsePtr&)>&& callback, int64_t id, const std::string& name) {
+    const bool acceptsGzip = detail::acceptsGzip(req->getHeader("accept-encoding"));
+
+    hanaru::Cancellation cancellation { req };
+    callback = cancellation.withDeadline(std::move(callback), hanaru::deadlines::download());
+
+    hanaru::downloader::downloadMap(id, [name, acceptsGzip, callback = std::move(callback)](std::tuple<HttpStatusCode, std::shared_ptr<const hanaru::Beatmap>, std::string>&& result) {
+        auto& [code, beatmap, error] = result;
+
+        if (beatmap == nullptr) {
+            callback(detail::downloadError(code, std::move(error)));
+            return;
+        }
+
+        const hanaru::ZipEntry* entry = beatmap->findEntry(name);
+        if (entry == nullptr) {
+            callback(detail::downloadError(k404NotFound, "file doesn't exist in this beatmapset"));
+            return;
+        }
+
+        HttpResponsePtr response = HttpResponse::newHttpResponse();
+        response->setContentTypeCodeAndCustomString(drogon::CT_CUSTOM, detail::contentTypeFromName(entry->name));
+        response->addHeader("Vary", "Accept-Encoding");
+
+        // Deflate stream from archive can be sent as is, only gzip header and trailer is required
+        if (entry->method == hanaru::ZipEntry::Method::Deflated && acceptsGzip) {
+            response->addHeader("Content-Encoding", "gzip");
+            response->setBody(hanaru::zip::toGzip(beatmap->content(), *entry));
+            callback(response);
+            return;
+        }
+
+        std::optional<std::string> content = hanaru::zip::extract(beatmap->content(), *entry);
+        if (!content.has_value()) {
+            callback(detail::downloadError(k422UnprocessableEntity, "file inside of archive is corrupted"));
+            return;
+        }
+
+        response->setBody(std::move(content.value()));
+        callback(response);
+    }, nullptr, std::move(cancellation));
+}
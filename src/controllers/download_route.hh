@@ -6,8 +6,13 @@ using namespace drogon;
 class DownloadRoute : public drogon::HttpController<DownloadRoute> {
 public:
     void get(const HttpRequestPtr& req, std::function<void(const HttpResponsePtr&)>&& callback, int64_t id);
+    void files(const HttpRequestPtr& req, std::function<void(const HttpResponsePtr&)>&& callback, int64_t id);
+    void file(const HttpRequestPtr& req, std::function<void(const HttpResponsePtr&)>&& callback, int64_t id, const std::string& name);
 
     METHOD_LIST_BEGIN
         ADD_METHOD_TO(DownloadRoute::get, "/d/{1}", Get);
+        ADD_METHOD_TO(DownloadRoute::files, "/d/{1}/files", Get);
+        // Names of files in subfolders contain slashes, so rest of path is taken as is
+        ADD_METHOD_VIA_REGEX(DownloadRoute::file, "/d/([0-9]+)/file/(.+)", Get);
     METHOD_LIST_END
 };
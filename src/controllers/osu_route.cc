@@ -0,0 +1,28 @@
+#include "osu_route.hh"
+
+#include "../impl/cancellation.hh"
+#include "../impl/difficulty_store.hh"
+
+void OsuRoute::get(const HttpRequestPtr& req, std::function<void(const HttpResponsePtr&)>&& callback, int64_t id) {
+    // Client receives 504 if database or osu! is too slow
+    callback = hanaru::Cancellation { req }.withDeadline(std::move(callback), hanaru::deadlines::lookup());
+
+    hanaru::difficulty_store::getOsuFile(id, [id, callback = std::move(callback)](std::tuple<HttpStatusCode, std::shared_ptr<const std::string>, std::string>&& result) {
+        auto& [code, osuFile, error] = result;
+        HttpResponsePtr response = HttpResponse::newHttpResponse();
+        response->setStatusCode(code);
+
+        if (osuFile == nullptr) {
+            response->setContentTypeCode(drogon::CT_TEXT_PLAIN);
+            response->setBody(std::move(error));
+            callback(response);
+            return;
+        }
+
+        response->setContentTypeCode(drogon::CT_TEXT_PLAIN);
+        response->addHeader("Content-Disposition", "attachment; filename=\"" + std::to_string(id) + ".osu\"");
+        response->setBody(*osuFile);
+
+        callback(response);
+    });
+}
@@ -0,0 +1,44 @@
+#include "stats_route.hh"
+
+#include "../impl/downloader.hh"
+#include "../impl/prefetcher.hh"
+#include "../impl/scheduler.hh"
+
+namespace detail {
+
+    // Usernames of accounts and beginnings of API keys are shown only to whoever knows `stats_token`
+    bool isTrusted(const HttpRequestPtr& req) {
+        const std::string& token = drogon::app().getCustomConfig()["stats_token"].asString();
+        return !token.empty() && req->getHeader("authorization") == "Bearer " + token;
+    }
+
+}
+
+void StatsRoute::get(const HttpRequestPtr& req, std::function<void(const HttpResponsePtr&)>&& callback) {
+    Json::Value stats = Json::objectValue;
+    stats["circuit_breakers"] = hanaru::downloader::circuitBreakers();
+
+    if (detail::isTrusted(req)) {
+        stats["sessions"] = hanaru::downloader::sessions();
+        stats["api_keys"] = hanaru::downloader::apiKeys();
+    }
+
+    stats["lookup_conversion"] = hanaru::prefetcher::conversion();
+
+    const std::pair<const char*, hanaru::Priority> priorities[] = {
+        { "interactive", hanaru::Priority::Interactive },
+        { "background", hanaru::Priority::Background },
+        { "bulk", hanaru::Priority::Bulk }
+    };
+
+    for (const auto& [name, priority] : priorities) {
+        Json::Value transfers = Json::objectValue;
+        transfers["active"] = static_cast<Json::UInt64>(hanaru::scheduler::activeTransfers(priority));
+        transfers["queued"] = static_cast<Json::UInt64>(hanaru::scheduler::queuedTransfers(priority));
+        stats["transfers"][name] = std::move(transfers);
+    }
+
+    HttpResponsePtr response = HttpResponse::newHttpJsonResponse(std::move(stats));
+    response->addHeader("Cache-Control", "no-store");
+    callback(response);
+}
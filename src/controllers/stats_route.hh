@@ -0,0 +1,13 @@
+#pragma once
+#include <drogon/HttpController.h>
+
+using namespace drogon;
+
+class StatsRoute : public drogon::HttpController<StatsRoute> {
+public:
+    void get(const HttpRequestPtr& req, std::function<void(const HttpResponsePtr&)>&& callback);
+
+    METHOD_LIST_BEGIN
+        ADD_METHOD_TO(StatsRoute::get, "/stats", Get);
+    METHOD_LIST_END
+};
@@ -0,0 +1,24 @@
+#include "thumbnail_route.hh"
+
+#include "../impl/thumbnailer.hh"
+
+void ThumbnailRoute::get(const HttpRequestPtr& req, std::function<void(const HttpResponsePtr&)>&& callback, int64_t id) {
+    hanaru::thumbnailer::getThumbnail(id, [callback = std::move(callback)](std::tuple<HttpStatusCode, std::shared_ptr<const std::string>, std::string>&& result) {
+        auto& [code, thumbnail, error] = result;
+        HttpResponsePtr response = HttpResponse::newHttpResponse();
+        response->setStatusCode(code);
+
+        if (thumbnail == nullptr) {
+            response->setContentTypeCode(drogon::CT_TEXT_PLAIN);
+            response->setBody(std::move(error));
+            callback(response);
+            return;
+        }
+
+        response->setContentTypeCode(drogon::CT_IMAGE_JPG);
+        response->addHeader("Cache-Control", "public, max-age=86400");
+        response->setBody(*thumbnail);
+
+        callback(response);
+    });
+}
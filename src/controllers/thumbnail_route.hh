@@ -0,0 +1,13 @@
+#pragma once
+#include <drogon/HttpController.h>
+
+using namespace drogon;
+
+class ThumbnailRoute : public drogon::HttpController<ThumbnailRoute> {
+public:
+    void get(const HttpRequestPtr& req, std::function<void(const HttpResponsePtr&)>&& callback, int64_t id);
+
+    METHOD_LIST_BEGIN
+        ADD_METHOD_TO(ThumbnailRoute::get, "/thumb/{1}", Get);
+    METHOD_LIST_END
+};
@@ -0,0 +1,37 @@
+#include "api_key.hh"
+
+namespace detail {
+
+    constexpr double apiKeyBurst = 200.0;
+    constexpr double apiKeyRefillRate = 1200.0 / 60.0;
+
+}
+
+hanaru::ApiKey::ApiKey(const std::string& key)
+    : key_ { key }
+    , budget_ { detail::apiKeyBurst, detail::apiKeyRefillRate }
+{}
+
+const std::string& hanaru::ApiKey::key() const {
+    return key_;
+}
+
+void hanaru::ApiKey::throttle(std::chrono::seconds cooldown) {
+    budget_.throttle(cooldown);
+}
+
+bool hanaru::ApiKey::acquire() {
+    return budget_.acquire();
+}
+
+double hanaru::ApiKey::remainingBudget() {
+    return budget_.remaining();
+}
+
+Json::Value hanaru::ApiKey::toJson() {
+    Json::Value result = Json::objectValue;
+    result["key"] = key_.substr(0, 4) + "...";
+    budget_.toJson(result);
+
+    return result;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+
+#include <json/json.h>
+
+#include "budget.hh"
+
+namespace hanaru {
+
+    // Single key of osu! API with own budget, so lookups can be spread between keys by their remaining budget.
+    // osu! allows 1200 requests per minute for every key with bursts of up to 200 requests above that,
+    // so budget holds 200 requests and is refilled by 20 requests every second.
+    class ApiKey {
+    public:
+        explicit ApiKey(const std::string& key);
+
+        ApiKey(const ApiKey& other) = delete;
+        ApiKey& operator=(const ApiKey& other) = delete;
+        ApiKey(ApiKey&& other) = delete;
+        ApiKey& operator=(ApiKey&& other) = delete;
+
+        const std::string& key() const;
+
+        // Takes key out of rotation until cooldown is over
+        void throttle(std::chrono::seconds cooldown);
+        // Takes single request from budget, returns false if key cannot be used right now
+        bool acquire();
+        // Amount of requests left in budget, or negative value if key cannot be used right now
+        double remainingBudget();
+
+        // Key itself is never shown, only its beginning
+        Json::Value toJson();
+
+    private:
+        std::string key_ {};
+        Budget budget_;
+    };
+
+}
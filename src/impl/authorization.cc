@@ -1,134 +1,253 @@
 #include "authorization.hh"
 
-#include "../thirdparty/curler.hh"
 #include "utils.hh"
 
-hanaru::Authorization::Authorization() : valid_(false) {}
+#include <drogon/HttpAppFramework.h>
 
-hanaru::Authorization::Authorization(const std::string& username, const std::string& password)
-    : username_ { username }
-    , password_ { password }
-    , valid_ { false }
-{
-    auth();
-}
+namespace detail {
 
-hanaru::Authorization::~Authorization() {
-    deAuth();
-}
+    // In milliseconds, login request that hangs would leave session logging in forever, and every download that waits for it as well
+    constexpr long loginTimeout = 15000;
+
+    const char* stateName(hanaru::Authorization::State state) {
+        switch (state) {
+            case hanaru::Authorization::State::LoggedOut: return "logged out";
+            case hanaru::Authorization::State::LoggingIn: return "logging in";
+            case hanaru::Authorization::State::Ready: return "ready";
+        }
+
+        return "unknown";
+    }
 
-hanaru::Authorization::Authorization(Authorization&& other) noexcept
-    : username_ { std::move(other.username_) }
-    , password_ { std::move(other.password_) }
-    , xsrfToken_ { std::move(other.xsrfToken_) }
-    , sessionToken_ { std::move(other.sessionToken_) }
-    , valid_ { other.valid_ }
-{
-    other.valid_ = false;
 }
 
-hanaru::Authorization& hanaru::Authorization::operator=(Authorization&& other) noexcept {
-    std::swap(this->username_, other.username_);
-    std::swap(this->password_, other.password_);
-    std::swap(this->xsrfToken_, other.xsrfToken_);
-    std::swap(this->sessionToken_, other.sessionToken_);
-    
-    this->valid_ = other.valid_;
-    other.valid_ = false;
+hanaru::Authorization::Authorization(curl::Factory& factory, const Credentials& credentials, uint64_t budget)
+    : factory_ { factory }
+    , username_ { credentials.username }
+    , password_ { credentials.password }
+    // Budget is restored linearly during an hour
+    , budget_ { static_cast<double>(budget), static_cast<double>(budget) / 3600.0 }
+{}
 
-    return *this;
+const std::string& hanaru::Authorization::username() const {
+    return username_;
 }
 
 void hanaru::Authorization::reAuth() {
-    deAuth();
-    auth();
+    std::string xsrfToken {};
+    std::string sessionToken {};
+
+    {
+        std::unique_lock<std::mutex> lock { mutex_ };
+
+        if (state_ == State::LoggingIn) {
+            return;
+        }
+
+        state_ = State::LoggingIn;
+        xsrfToken = std::move(xsrfToken_);
+        sessionToken = std::move(sessionToken_);
+        xsrfToken_.clear();
+        sessionToken_.clear();
+    }
+
+    // Previous session is closed in background, nobody waits for result of it
+    if (!xsrfToken.empty() && !sessionToken.empty()) {
+        curl::Builder builder = factory_.createRequest("https://osu.ppy.sh");
+        builder
+            .setPath("/session")
+            .setReferer("https://osu.ppy.sh")
+            .addHeader("Origin", "https://osu.ppy.sh")
+            .addHeader("Alt-Used", "osu.ppy.sh")
+            .addHeader("X-CSRF-Token", xsrfToken)
+            .addCookie("XSRF-TOKEN", xsrfToken)
+            .addCookie("osu_session", sessionToken)
+            .setRequestType(curl::RequestType::DELETE)
+            .setTimeout(detail::loginTimeout);
+        factory_.pushRequest(builder);
+    }
+
+    requestMainPage();
 }
 
-void hanaru::Authorization::deAuth() {
-    if (!valid_ || sessionToken_.empty() || xsrfToken_.empty()) {
+void hanaru::Authorization::whenReady(ReadyHandler&& handler) {
+    std::unique_lock<std::mutex> lock { mutex_ };
+
+    if (state_ == State::LoggingIn) {
+        waiters_.push_back(std::move(handler));
         return;
     }
 
-    curl::client client("https://osu.ppy.sh");
+    const bool ready = state_ == State::Ready;
+    lock.unlock();
 
-    client.set_path("/session");
-    client.set_referer("https://osu.ppy.sh/home");
+    handler(ready);
+}
+
+void hanaru::Authorization::authorize(curl::Builder& builder) {
+    std::unique_lock<std::mutex> lock { mutex_ };
 
-    client.add_header("Origin", "https://osu.ppy.sh");
-    client.add_header("Alt-Used", "osu.ppy.sh");
-    client.add_header("X-CSRF-Token", xsrfToken_);
+    builder
+        .addHeader("X-CSRF-Token", xsrfToken_)
+        .addCookie("XSRF-TOKEN", xsrfToken_)
+        .addCookie("osu_session", sessionToken_);
+}
+
+void hanaru::Authorization::update(const curl::Response& response) {
+    std::unique_lock<std::mutex> lock { mutex_ };
+
+    const auto range = response.cookies.equal_range("xsrf-token");
+    for (auto it = range.first; it != range.second; it++) {
+        if (it->second.value.size() == xsrfToken_.size() && it->second.domain == ".ppy.sh") {
+            xsrfToken_ = it->second.value;
+            break;
+        }
+    }
+}
 
-    client.add_cookie("XSRF-TOKEN", xsrfToken_);
-    client.add_cookie("osu_session", sessionToken_);
+void hanaru::Authorization::throttle(std::chrono::seconds cooldown) {
+    budget_.throttle(cooldown);
+}
 
-    client.del();
-    xsrfToken_.clear();
-    sessionToken_.clear();
+bool hanaru::Authorization::acquire() {
+    return state() == State::Ready && budget_.acquire();
 }
 
-std::string hanaru::Authorization::xsrf() const {
-    return xsrfToken_;
+double hanaru::Authorization::remainingBudget() {
+    if (state() != State::Ready) {
+        return -1.0;
+    }
+
+    return budget_.remaining();
 }
 
-std::string hanaru::Authorization::session() const {
-    return sessionToken_;
+hanaru::Authorization::State hanaru::Authorization::state() {
+    std::unique_lock<std::mutex> lock { mutex_ };
+    return state_;
 }
 
-bool hanaru::Authorization::isValid() const {
-    return valid_;
+Json::Value hanaru::Authorization::toJson() {
+    Json::Value result = Json::objectValue;
+    result["username"] = username_;
+    result["state"] = detail::stateName(state());
+    budget_.toJson(result);
+
+    return result;
 }
 
-void hanaru::Authorization::auth() {
-    curl::client client("https://osu.ppy.sh");
-    client.set_user_agent(HANARU_USER_AGENT);
-    client.set_path("/home");
+void hanaru::Authorization::requestMainPage() {
+    std::weak_ptr<Authorization> self = weak_from_this();
+
+    curl::Builder builder = factory_.createRequest("https://osu.ppy.sh");
+    builder
+        .setPath("/home")
+        .setUserAgent(HANARU_USER_AGENT)
+        .setRequestType(curl::RequestType::GET)
+        .setTimeout(detail::loginTimeout)
+        .onComplete([self](curl::Response& r) {
+            if (std::shared_ptr<Authorization> session = self.lock()) {
+                if (r.code != curl::StatusCode::Values::OK) {
+                    session->finishLogin(false);
+                    return;
+                }
+
+                session->requestSession(r);
+            }
+        })
+        .onError([self](curl::Response&) {
+            if (std::shared_ptr<Authorization> session = self.lock()) {
+                session->finishLogin(false);
+            }
+        });
 
-    curl::response session_request = client.get();
+    factory_.pushRequest(builder);
+}
 
-    if (session_request.code != curl::status_code::values::ok) {
-        return;
-    }
+void hanaru::Authorization::requestSession(const curl::Response& mainPage) {
+    std::weak_ptr<Authorization> self = weak_from_this();
+    std::string xsrfToken {};
 
-    for (const auto [_, cookie] : session_request.cookies) {
-        client.add_cookie(cookie.key, cookie.value);
+    curl::Builder builder = factory_.createRequest("https://osu.ppy.sh");
+    for (const auto& [_, cookie] : mainPage.cookies) {
+        builder.addCookie(cookie.key, cookie.value);
 
         if (cookie.key == "XSRF-TOKEN") {
-            xsrf_token_ = cookie.value;
+            xsrfToken = cookie.value;
         }
     }
 
-    client.set_path("/session");
-    client.set_referer("https://osu.ppy.sh/home");
+    builder
+        .setPath("/session")
+        .setUserAgent(HANARU_USER_AGENT)
+        .setReferer("https://osu.ppy.sh/home")
+        .addHeader("Origin", "https://osu.ppy.sh")
+        .addHeader("Alt-Used", "osu.ppy.sh")
+        .addHeader("Content-Type", "application/x-www-form-urlencoded; charset=UTF-8")
+        .addHeader("X-CSRF-Token", xsrfToken)
+        .setRequestType(curl::RequestType::POST)
+        .setTimeout(detail::loginTimeout)
+        .setBody(
+            "_token=" + curl::Utils::urlEncode(xsrfToken) +
+            "&username=" + curl::Utils::urlEncode(username_) +
+            "&password=" + curl::Utils::urlEncode(password_)
+        )
+        .onComplete([self, xsrfToken](curl::Response& r) mutable {
+            std::shared_ptr<Authorization> session = self.lock();
+            if (session == nullptr) {
+                return;
+            }
 
-    client.add_header("Origin", "https://osu.ppy.sh");
-    client.add_header("Alt-Used", "osu.ppy.sh");
-    client.add_header("Content-Type", "application/x-www-form-urlencoded; charset=UTF-8");
-    client.add_header("X-CSRF-Token", xsrf_token_);
+            if (r.code != curl::StatusCode::Values::OK) {
+                session->finishLogin(false);
+                return;
+            }
 
-    curl::response login_request = client.post(
-        "_token=" + curl::utils::url_encode(xsrf_token_) +
-        "&username=" + curl::utils::url_encode(username_) +
-        "&password=" + curl::utils::url_encode(password_)
-    );
+            std::string sessionToken {};
+            for (const auto& [_, cookie] : r.cookies) {
+                if (cookie.domain == ".ppy.sh") {
+                    if (cookie.key == "XSRF-TOKEN") {
+                        xsrfToken = cookie.value;
+                    }
+
+                    if (cookie.key == "osu_session") {
+                        sessionToken = cookie.value;
+                    }
+                }
+            }
 
-    if (login_request.code != curl::status_code::values::ok) {
-        return;
-    }
+            session->finishLogin(true, std::move(xsrfToken), std::move(sessionToken));
+        })
+        .onError([self](curl::Response&) {
+            if (std::shared_ptr<Authorization> session = self.lock()) {
+                session->finishLogin(false);
+            }
+        });
 
-    client.reset_cookies();
-    client.reset_headers();
+    factory_.pushRequest(builder);
+}
 
-    for (const auto [_, cookie] : login_request.cookies) {
-        if (cookie.domain == ".ppy.sh") {
-            if (cookie.key == "XSRF-TOKEN") {
-                xsrf_token_ = cookie.value;
-            }
+void hanaru::Authorization::finishLogin(bool success, std::string&& xsrfToken, std::string&& sessionToken) {
+    std::vector<ReadyHandler> waiters {};
 
-            if (cookie.key == "osu_session") {
-                session_token_ = cookie.value;
-            }
-        }
+    {
+        std::unique_lock<std::mutex> lock { mutex_ };
+        state_ = success ? State::Ready : State::LoggedOut;
+        xsrfToken_ = std::move(xsrfToken);
+        sessionToken_ = std::move(sessionToken);
+        waiters.swap(waiters_);
     }
 
-    valid_ = true;
+    if (success) {
+        LOG_INFO << "Authorized on osu! as " << username_;
+    }
+    else {
+        LOG_WARN << "Failed to authorize " << username_ << " on osu!";
+    }
+
+    // This is called from curl thread, so waiters that start new downloads are moved out of it
+    drogon::app().getLoop()->queueInLoop([waiters = std::move(waiters), success]() {
+        for (const ReadyHandler& waiter : waiters) {
+            waiter(success);
+        }
+    });
 }
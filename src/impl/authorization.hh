@@ -1,36 +1,86 @@
 #pragma once
 
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <vector>
+
+#include <json/json.h>
+
+#include "budget.hh"
+#include "../thirdparty/curler.hh"
 
 namespace hanaru {
 
-    class Authorization {
+    class Credentials {
+    public:
+        std::string username {};
+        std::string password {};
+    };
+
+    // Web session of single osu! account, which is used to download archives.
+    // Every session has own budget of downloads, so load can be spread between accounts by their remaining budget.
+    // Logging in is asynchronous and never blocks caller, so it can be started from any thread, including curl one.
+    class Authorization : public std::enable_shared_from_this<Authorization> {
     public:
-        Authorization();
-        Authorization(const std::string& username, const std::string& password);
-        ~Authorization();
+        enum class State : uint8_t {
+            LoggedOut = 0,
+            LoggingIn = 1,
+            Ready = 2
+        };
+
+        // Receives true if session is ready, false if logging in failed
+        using ReadyHandler = std::function<void(bool)>;
 
-        Authorization(const Authorization& other) noexcept = delete;
-        Authorization& operator=(const Authorization& other) noexcept = delete;
-        Authorization(Authorization&& other) noexcept;
-        Authorization& operator=(Authorization&& other) noexcept;
+        // Budget is amount of downloads per hour, 0 means unlimited.
+        // Session is logged out until first `reAuth` call.
+        Authorization(curl::Factory& factory, const Credentials& credentials, uint64_t budget);
 
+        Authorization(const Authorization& other) = delete;
+        Authorization& operator=(const Authorization& other) = delete;
+        Authorization(Authorization&& other) = delete;
+        Authorization& operator=(Authorization&& other) = delete;
+
+        const std::string& username() const;
+
+        // Drops current session and logs in again, does nothing if session is already logging in
         void reAuth();
-        void deAuth();
+        // Handler is called from event loop once logging in is done, or immediately if session isn't logging in right now
+        void whenReady(ReadyHandler&& handler);
+
+        // Adds session cookies and CSRF token into request
+        void authorize(curl::Builder& builder);
+        // osu! rotates XSRF token from time to time, so it must be taken from every successful response
+        void update(const curl::Response& response);
 
-        std::string xsrf() const;
-        std::string session() const;
+        // Takes session out of rotation until cooldown is over
+        void throttle(std::chrono::seconds cooldown);
+        // Takes single download from budget, returns false if session cannot be used right now
+        bool acquire();
+        // Amount of downloads left in budget, or negative value if session cannot be used right now
+        double remainingBudget();
 
-        bool isValid() const;
+        State state();
+
+        Json::Value toJson();
 
     private:
-        void auth();
+        void requestMainPage();
+        void requestSession(const curl::Response& mainPage);
+        void finishLogin(bool success, std::string&& xsrfToken = "", std::string&& sessionToken = "");
 
+        curl::Factory& factory_;
         std::string username_ {};
         std::string password_ {};
 
+        std::mutex mutex_ {};
+        State state_ = State::LoggedOut;
         std::string xsrfToken_ {};
         std::string sessionToken_ {};
-        bool valid_;
+        std::vector<ReadyHandler> waiters_ {};
+
+        Budget budget_;
     };
-}
\ No newline at end of file
+}
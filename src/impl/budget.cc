@@ -0,0 +1,72 @@
+#include "budget.hh"
+
+#include <algorithm>
+#include <limits>
+
+hanaru::Budget::Budget(double capacity, double refillRate)
+    : capacity_ { capacity }
+    , refillRate_ { refillRate }
+    , tokens_ { capacity }
+    , refilledAt_ { Clock::now() }
+{}
+
+void hanaru::Budget::throttle(std::chrono::seconds cooldown) {
+    std::unique_lock<std::mutex> lock { mutex_ };
+    throttledUntil_ = std::max(throttledUntil_, Clock::now() + cooldown);
+}
+
+bool hanaru::Budget::acquire() {
+    std::unique_lock<std::mutex> lock { mutex_ };
+    const Clock::time_point now = Clock::now();
+
+    if (now < throttledUntil_) {
+        return false;
+    }
+
+    if (capacity_ == 0) {
+        return true;
+    }
+
+    refill(now);
+
+    if (tokens_ < 1.0) {
+        return false;
+    }
+
+    tokens_ -= 1.0;
+    return true;
+}
+
+double hanaru::Budget::remaining() {
+    std::unique_lock<std::mutex> lock { mutex_ };
+    const Clock::time_point now = Clock::now();
+
+    if (now < throttledUntil_) {
+        return -1.0;
+    }
+
+    if (capacity_ == 0) {
+        return std::numeric_limits<double>::max();
+    }
+
+    refill(now);
+    return tokens_;
+}
+
+void hanaru::Budget::toJson(Json::Value& result) {
+    std::unique_lock<std::mutex> lock { mutex_ };
+    const Clock::time_point now = Clock::now();
+
+    if (capacity_ != 0) {
+        refill(now);
+    }
+
+    result["throttled_for"] = static_cast<Json::Int64>(now < throttledUntil_ ? std::chrono::ceil<std::chrono::seconds>(throttledUntil_ - now).count() : 0);
+    result["budget"] = capacity_ == 0 ? Json::Value {} : Json::Value { static_cast<Json::UInt64>(tokens_) };
+}
+
+void hanaru::Budget::refill(Clock::time_point now) {
+    const double elapsed = std::chrono::duration<double>(now - refilledAt_).count();
+    tokens_ = std::min(capacity_, tokens_ + elapsed * refillRate_);
+    refilledAt_ = now;
+}
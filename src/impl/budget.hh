@@ -0,0 +1,85 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <json/json.h>
+
+namespace hanaru {
+
+    // Token bucket that holds up to `capacity` requests and is refilled by `refillRate` requests every second, 0 capacity means unlimited.
+    // Owner might be taken out of rotation for a while, e.g. after osu! rate limited it.
+    class Budget {
+    public:
+        Budget(double capacity, double refillRate);
+
+        Budget(const Budget& other) = delete;
+        Budget& operator=(const Budget& other) = delete;
+        Budget(Budget&& other) = delete;
+        Budget& operator=(Budget&& other) = delete;
+
+        // Takes owner out of rotation until cooldown is over
+        void throttle(std::chrono::seconds cooldown);
+        // Takes single request from budget, returns false if owner cannot be used right now
+        bool acquire();
+        // Amount of requests left in budget, or negative value if owner cannot be used right now
+        double remaining();
+
+        // Adds `throttled_for` and `budget` (null if unlimited) into object
+        void toJson(Json::Value& result);
+
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        // Lock must be held by caller
+        void refill(Clock::time_point now);
+
+        std::mutex mutex_ {};
+        double capacity_ = 0;
+        double refillRate_ = 0;
+        double tokens_ = 0;
+        Clock::time_point refilledAt_ {};
+        Clock::time_point throttledUntil_ {};
+    };
+
+    // Picks owner with the largest remaining budget and takes single request from it, owners with equal budget are used in turns.
+    // Owners must have `remainingBudget` and `acquire` methods, lock must be held by caller.
+    template <typename T>
+    std::shared_ptr<T> acquireLargestBudget(const std::vector<std::shared_ptr<T>>& owners, size_t& next) {
+        std::shared_ptr<T> best = nullptr;
+        double bestBudget = 0.0;
+
+        for (size_t i = 0; i < owners.size(); i++) {
+            const std::shared_ptr<T>& owner = owners[(next + i) % owners.size()];
+            const double budget = owner->remainingBudget();
+
+            if (budget >= 1.0 && budget > bestBudget) {
+                best = owner;
+                bestBudget = budget;
+            }
+        }
+
+        if (best == nullptr || !best->acquire()) {
+            return nullptr;
+        }
+
+        next++;
+        return best;
+    }
+
+    // Returns true if at least one owner isn't taken out of rotation, lock must be held by caller
+    template <typename T>
+    bool hasAvailableBudget(const std::vector<std::shared_ptr<T>>& owners) {
+        for (const std::shared_ptr<T>& owner : owners) {
+            if (owner->remainingBudget() >= 0.0) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+}
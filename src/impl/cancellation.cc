@@ -0,0 +1,77 @@
+#include "cancellation.hh"
+
+#include <drogon/HttpAppFramework.h>
+#include <trantor/net/TcpConnection.h>
+
+namespace detail {
+
+    uint64_t lookupDeadline_ = 0;
+    uint64_t downloadDeadline_ = 0;
+
+}
+
+namespace hanaru {
+
+    Cancellation::Cancellation(const drogon::HttpRequestPtr& req)
+        : state_ { std::make_shared<State>() }
+    {
+        state_->connection = req->getConnectionPtr();
+    }
+
+    std::function<void(const drogon::HttpResponsePtr&)> Cancellation::withDeadline(std::function<void(const drogon::HttpResponsePtr&)>&& callback, uint64_t seconds) {
+        if (seconds == 0 || state_ == nullptr) {
+            return std::move(callback);
+        }
+
+        auto sharedCallback = std::make_shared<std::function<void(const drogon::HttpResponsePtr&)>>(std::move(callback));
+
+        drogon::app().getLoop()->runAfter(static_cast<double>(seconds), [state = state_, sharedCallback]() {
+            if (state->responded.exchange(true)) {
+                return;
+            }
+
+            state->cancelled = true;
+
+            drogon::HttpResponsePtr response = drogon::HttpResponse::newHttpResponse();
+            response->setStatusCode(drogon::k504GatewayTimeout);
+            response->setBody("request took too long, please try again later");
+            response->setContentTypeCode(drogon::CT_TEXT_PLAIN);
+            (*sharedCallback)(response);
+        });
+
+        return [state = state_, sharedCallback](const drogon::HttpResponsePtr& response) {
+            if (state->responded.exchange(true)) {
+                return;
+            }
+
+            (*sharedCallback)(response);
+        };
+    }
+
+    bool Cancellation::cancelled() const {
+        if (state_ == nullptr) {
+            return false;
+        }
+
+        if (state_->cancelled) {
+            return true;
+        }
+
+        std::shared_ptr<trantor::TcpConnection> connection = state_->connection.lock();
+        return connection == nullptr || connection->disconnected();
+    }
+
+    void deadlines::initialize(uint64_t lookup, uint64_t download) {
+        detail::lookupDeadline_ = lookup;
+        detail::downloadDeadline_ = download;
+    }
+
+    uint64_t deadlines::lookup() {
+        return detail::lookupDeadline_;
+    }
+
+    uint64_t deadlines::download() {
+        return detail::downloadDeadline_;
+    }
+
+}
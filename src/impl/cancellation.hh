@@ -0,0 +1,49 @@
+#pragma once
+
+#include <drogon/HttpRequest.h>
+#include <drogon/HttpResponse.h>
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+namespace hanaru {
+
+    // Tells whether client that made request still waits for response, copies share the same state.
+    // Client stops waiting when it closes connection or when deadline of route is over.
+    class Cancellation {
+    public:
+        // Never cancelled, used by background jobs
+        Cancellation() = default;
+        // Cancelled once connection of request is closed
+        explicit Cancellation(const drogon::HttpRequestPtr& req);
+
+        // Client receives 504 if response isn't sent in `seconds` (0 means no deadline), then token is cancelled and late response is dropped
+        std::function<void(const drogon::HttpResponsePtr&)> withDeadline(std::function<void(const drogon::HttpResponsePtr&)>&& callback, uint64_t seconds);
+
+        bool cancelled() const;
+
+    private:
+        class State {
+        public:
+            std::weak_ptr<trantor::TcpConnection> connection {};
+            std::atomic_bool cancelled = false;
+            std::atomic_bool responded = false;
+        };
+
+        std::shared_ptr<State> state_ {};
+    };
+
+    namespace deadlines {
+
+        // Both deadlines are in seconds and cover everything until response starts, 0 disables deadline.
+        // Lookup deadline is used by `/b/` and `/s/`, download deadline by `/d/` and its subroutes.
+        void initialize(uint64_t lookup, uint64_t download);
+
+        uint64_t lookup();
+        uint64_t download();
+
+    }
+
+}
@@ -0,0 +1,147 @@
+#include "circuit_breaker.hh"
+
+#include <trantor/utils/Logger.h>
+
+#include <algorithm>
+
+namespace detail {
+
+    const char* stateName(hanaru::CircuitBreaker::State state) {
+        switch (state) {
+            case hanaru::CircuitBreaker::State::Closed: return "closed";
+            case hanaru::CircuitBreaker::State::Open: return "open";
+            case hanaru::CircuitBreaker::State::HalfOpen: return "half-open";
+        }
+
+        return "unknown";
+    }
+
+}
+
+namespace hanaru {
+
+    CircuitBreaker::CircuitBreaker(std::string&& name)
+        : name_ { std::move(name) }
+    {}
+
+    void CircuitBreaker::configure(size_t failureThreshold, uint64_t baseBackoff, uint64_t maxBackoff) {
+        std::unique_lock<std::mutex> lock { mutex_ };
+
+        failureThreshold_ = std::max<size_t>(failureThreshold, 1);
+        baseBackoff_ = std::chrono::seconds(std::max<uint64_t>(baseBackoff, 1));
+        maxBackoff_ = std::max(baseBackoff_, Clock::duration { std::chrono::seconds(maxBackoff) });
+    }
+
+    bool CircuitBreaker::allow() {
+        std::unique_lock<std::mutex> lock { mutex_ };
+
+        if (state_ == State::Closed) {
+            return true;
+        }
+
+        const Clock::time_point now = Clock::now();
+        if (now < retryAt_) {
+            return false;
+        }
+
+        if (state_ == State::Open) {
+            state_ = State::HalfOpen;
+            LOG_INFO << "Circuit breaker of " << name_ << " is half-open, sending probe";
+        }
+
+        // Probe that never reported back (e.g. request was dropped) must not keep breaker half-open forever
+        retryAt_ = now + maxBackoff_;
+        return true;
+    }
+
+    void CircuitBreaker::recordSuccess() {
+        std::unique_lock<std::mutex> lock { mutex_ };
+
+        failures_ = 0;
+
+        if (state_ == State::Closed) {
+            return;
+        }
+
+        state_ = State::Closed;
+        attempts_ = 0;
+        LOG_INFO << "Circuit breaker of " << name_ << " is closed, upstream recovered";
+    }
+
+    void CircuitBreaker::recordFailure() {
+        std::unique_lock<std::mutex> lock { mutex_ };
+
+        // Requests that were sent before breaker opened cannot extend backoff, only failed probe can
+        if (state_ == State::Open) {
+            return;
+        }
+
+        if (state_ == State::HalfOpen || ++failures_ >= failureThreshold_) {
+            open("upstream is failing");
+        }
+    }
+
+    void CircuitBreaker::recordThrottled() {
+        std::unique_lock<std::mutex> lock { mutex_ };
+
+        if (state_ == State::Open) {
+            return;
+        }
+
+        open("upstream throttled us");
+    }
+
+    void CircuitBreaker::recordSkipped() {
+        std::unique_lock<std::mutex> lock { mutex_ };
+
+        if (state_ == State::HalfOpen) {
+            retryAt_ = Clock::now();
+        }
+    }
+
+    CircuitBreaker::State CircuitBreaker::state() {
+        std::unique_lock<std::mutex> lock { mutex_ };
+        return state_;
+    }
+
+    uint64_t CircuitBreaker::retryAfter() {
+        std::unique_lock<std::mutex> lock { mutex_ };
+
+        const Clock::time_point now = Clock::now();
+        if (state_ == State::Closed || now >= retryAt_) {
+            return 0;
+        }
+
+        // Rounded up, so client that waits exactly that long won't hit breaker again
+        return static_cast<uint64_t>(std::chrono::ceil<std::chrono::seconds>(retryAt_ - now).count());
+    }
+
+    Json::Value CircuitBreaker::toJson() {
+        const uint64_t retry = retryAfter();
+        std::unique_lock<std::mutex> lock { mutex_ };
+
+        Json::Value result = Json::objectValue;
+        result["state"] = detail::stateName(state_);
+        result["consecutive_failures"] = static_cast<Json::UInt64>(failures_);
+        result["trips"] = static_cast<Json::UInt64>(trips_);
+        result["retry_after"] = static_cast<Json::UInt64>(retry);
+
+        return result;
+    }
+
+    void CircuitBreaker::open(const char* reason) {
+        // Every unsuccessful probe doubles backoff, random part prevents every instance from probing at the same time
+        const Clock::duration backoff = std::min(maxBackoff_, baseBackoff_ * (Clock::duration::rep { 1 } << std::min<size_t>(attempts_, 20)));
+        std::uniform_int_distribution<Clock::duration::rep> jitter { backoff.count() / 2, backoff.count() };
+
+        state_ = State::Open;
+        failures_ = 0;
+        attempts_++;
+        trips_++;
+        retryAt_ = Clock::now() + Clock::duration { jitter(random_) };
+
+        LOG_WARN << "Circuit breaker of " << name_ << " is open (" << reason << "), next probe in "
+            << std::chrono::ceil<std::chrono::seconds>(retryAt_ - Clock::now()).count() << " seconds";
+    }
+
+}
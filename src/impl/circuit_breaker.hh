@@ -0,0 +1,73 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <random>
+#include <string>
+
+#include <json/json.h>
+
+namespace hanaru {
+
+    // Stops requests to upstream endpoint that throttles us or keeps failing, so we don't extend the ban by retrying.
+    // Breaker opens immediately on 429 and after `failureThreshold` consecutive failures otherwise,
+    // then lets single probe through after backoff that grows exponentially with every unsuccessful probe.
+    class CircuitBreaker {
+    public:
+        enum class State : uint8_t {
+            Closed = 0,
+            Open = 1,
+            HalfOpen = 2
+        };
+
+        explicit CircuitBreaker(std::string&& name);
+
+        CircuitBreaker(const CircuitBreaker&) = delete;
+        CircuitBreaker& operator=(const CircuitBreaker&) = delete;
+
+        // Backoff is in seconds, actual delay is randomly picked between half and full backoff of current attempt
+        void configure(size_t failureThreshold, uint64_t baseBackoff, uint64_t maxBackoff);
+
+        // Returns false if request must not be sent, every allowed request must be followed by one of `record*` calls
+        bool allow();
+
+        // Upstream responded, even if response wasn't what we wanted (e.g. 404)
+        void recordSuccess();
+        // Upstream is unavailable, e.g. 5xx or connection error
+        void recordFailure();
+        // Upstream explicitly asked us to slow down
+        void recordThrottled();
+        // Allowed request wasn't sent after all, so probe is handed to next request
+        void recordSkipped();
+
+        State state();
+        // Seconds until next probe, 0 if breaker is closed
+        uint64_t retryAfter();
+
+        Json::Value toJson();
+
+    private:
+        using Clock = std::chrono::steady_clock;
+
+        // Lock must be held by caller
+        void open(const char* reason);
+
+        std::mutex mutex_ {};
+        std::string name_ {};
+        std::mt19937 random_ { std::random_device {}() };
+
+        size_t failureThreshold_ = 5;
+        Clock::duration baseBackoff_ = std::chrono::seconds(30);
+        Clock::duration maxBackoff_ = std::chrono::seconds(900);
+
+        State state_ = State::Closed;
+        size_t failures_ = 0;
+        // Number of times breaker was opened in a row without successful probe
+        size_t attempts_ = 0;
+        uint64_t trips_ = 0;
+        Clock::time_point retryAt_ {};
+    };
+
+}
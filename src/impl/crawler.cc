@@ -0,0 +1,169 @@
+#include "crawler.hh"
+
+#include "downloader.hh"
+#include "prefetcher.hh"
+#include "utils.hh"
+
+#include <drogon/HttpAppFramework.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <ctime>
+
+namespace detail {
+
+    // osu! API has no beatmaps approved before that
+    const std::string initialCursor = "2007-01-01 00:00:00";
+    const std::string cursorName = "crawler_cursor";
+
+    uint64_t crawlerPageSize_ = 0;
+    std::atomic_bool crawling_ = false;
+
+    void crawl();
+
+    // osu! API returns dates in UTC, so local time helpers from utils would shift cursor by timezone offset
+    int64_t utcStringToTime(const std::string& time) {
+        struct tm tmTime {};
+
+        if (sscanf(time.c_str(), "%d-%d-%d %d:%d:%d", &tmTime.tm_year, &tmTime.tm_mon, &tmTime.tm_mday, &tmTime.tm_hour, &tmTime.tm_min, &tmTime.tm_sec) != 6) {
+            return hanaru::timeFromEpoch();
+        }
+
+        tmTime.tm_year -= 1900;
+        tmTime.tm_mon -= 1;
+
+#ifndef _WIN32
+        return static_cast<int64_t>(timegm(&tmTime));
+#else
+        return static_cast<int64_t>(_mkgmtime(&tmTime));
+#endif
+    }
+
+    std::string timeToUtcString(int64_t time) {
+        char buffer[128] = { 0 };
+        time_t seconds = static_cast<time_t>(time);
+        struct tm tmTime;
+
+#ifndef _WIN32
+        gmtime_r(&seconds, &tmTime);
+#else
+        gmtime_s(&tmTime, &seconds);
+#endif
+
+        snprintf(buffer, sizeof(buffer), "%4d-%02d-%02d %02d:%02d:%02d",
+            tmTime.tm_year + 1900,
+            tmTime.tm_mon + 1,
+            tmTime.tm_mday,
+            tmTime.tm_hour,
+            tmTime.tm_min,
+            tmTime.tm_sec
+        );
+
+        return buffer;
+    }
+
+    void saveCursor(const std::string& cursor) {
+        drogon::orm::DbClientPtr db = drogon::app().getDbClient();
+
+        db->execSqlAsync(
+            "INSERT INTO hanaru_state (name, value) VALUES (?, ?) ON DUPLICATE KEY UPDATE value = VALUES(value);",
+            [](const drogon::orm::Result&) {},
+            [](const drogon::orm::DrogonDbException&) {},
+            cursorName, cursor
+        );
+    }
+
+    // Beatmaps are sorted by approval date, but whole beatmapsets share it, so full page might end in the middle of beatmapset.
+    // Cursor is moved one second back in that case, so the rest of beatmapset is on the next page (rows that are synced twice are just upserted again).
+    std::string nextCursor(const std::string& cursor, const std::vector<hanaru::ApiBeatmap>& beatmaps) {
+        int64_t latest = utcStringToTime(cursor);
+
+        for (const hanaru::ApiBeatmap& beatmap : beatmaps) {
+            if (!beatmap.approvedDate.empty()) {
+                latest = std::max(latest, utcStringToTime(beatmap.approvedDate));
+            }
+        }
+
+        if (beatmaps.size() < crawlerPageSize_) {
+            return timeToUtcString(latest);
+        }
+
+        // Page is entirely made of beatmaps approved at the same second, stepping back would loop forever
+        const std::string previous = timeToUtcString(latest - 1);
+        return previous == cursor ? timeToUtcString(latest) : previous;
+    }
+
+    void crawlFrom(const std::string& cursor) {
+        hanaru::downloader::syncBeatmaps(cursor, crawlerPageSize_, [cursor](std::tuple<std::vector<hanaru::ApiBeatmap>, drogon::HttpStatusCode>&& result) {
+            const auto& [beatmaps, code] = result;
+
+            // Cursor stays where it was, so the same page will be requested on next interval
+            if (code != drogon::k200OK) {
+                crawling_ = false;
+                return;
+            }
+
+            for (const hanaru::ApiBeatmap& beatmap : beatmaps) {
+                if (!beatmap.approvedDate.empty()) {
+                    hanaru::prefetcher::notifyApproved(beatmap.beatmapsetId, beatmap.rankedStatus, utcStringToTime(beatmap.approvedDate));
+                }
+            }
+
+            const std::string next = nextCursor(cursor, beatmaps);
+            if (next != cursor) {
+                saveCursor(next);
+            }
+
+            crawling_ = false;
+
+            if (!beatmaps.empty()) {
+                LOG_INFO << "Synced " << beatmaps.size() << " beatmaps approved since " << cursor;
+            }
+
+            // osu! has more beatmaps for us right now, there is no reason to wait for next interval
+            if (beatmaps.size() >= crawlerPageSize_ && next != cursor) {
+                drogon::app().getLoop()->queueInLoop(&crawl);
+            }
+        });
+    }
+
+    void crawl() {
+        if (crawling_.exchange(true)) {
+            return;
+        }
+
+        // Same price as in /s/ route, if we out of tokens then users should be served first
+        if (!hanaru::verifyRateLimit(10)) {
+            crawling_ = false;
+            return;
+        }
+
+        drogon::orm::DbClientPtr db = drogon::app().getDbClient();
+
+        db->execSqlAsync(
+            "SELECT value FROM hanaru_state WHERE name = ?;",
+            [](const drogon::orm::Result& result) {
+                crawlFrom(result.empty() ? initialCursor : result[0]["value"].as<std::string>());
+            },
+            [](const drogon::orm::DrogonDbException&) { crawling_ = false; },
+            cursorName
+        );
+    }
+
+}
+
+namespace hanaru {
+
+    void crawler::initialize(uint64_t interval, uint64_t pageSize) {
+        if (interval == 0 || pageSize == 0) {
+            return;
+        }
+
+        // osu! API doesn't return more than 500 beatmaps per request
+        detail::crawlerPageSize_ = std::min<uint64_t>(pageSize, 500);
+
+        drogon::app().getLoop()->runEvery(static_cast<double>(interval), &detail::crawl);
+    }
+
+}
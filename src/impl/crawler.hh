@@ -0,0 +1,18 @@
+#pragma once
+
+#include <cstdint>
+
+namespace hanaru {
+
+    namespace crawler {
+
+        // Keeps `beatmaps` in sync with osu! by paging through every ranked, approved, qualified and loved beatmap.
+        // Position is persisted in `hanaru_state`, so crawling continues from the same place after restart.
+        // Every `interval` seconds next page of up to `pageSize` beatmaps is requested, full pages are followed immediately,
+        // so crawler catches up quickly and then only picks up new rankings.
+        // Interval of 0 disables crawling.
+        void initialize(uint64_t interval, uint64_t pageSize);
+
+    }
+
+}
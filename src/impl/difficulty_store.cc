@@ -0,0 +1,196 @@
+#include "difficulty_store.hh"
+
+#include "downloader.hh"
+#include "osu_file.hh"
+#include "storage_manager.hh"
+#include "utils.hh"
+
+#include <drogon/utils/Utilities.h>
+
+#include <algorithm>
+#include <cctype>
+
+#include "../thirdparty/concurrent_cache.hh"
+
+namespace detail {
+
+    using OsuFileResult = std::tuple<drogon::HttpStatusCode, std::shared_ptr<const std::string>, std::string>;
+
+    // Hash of difficulty is kept with file, so file is served from memory only while it matches stored metadata
+    class CachedOsuFile {
+    public:
+        std::string md5 {};
+        std::string content {};
+    };
+
+    // Files are tiny and score servers ask for the same ones over and over
+    cache::LRUCache<int64_t, CachedOsuFile, 4096> osuFileCache_ {};
+
+    std::string osuFileMd5(const std::string& content) {
+        std::string md5 = drogon::utils::getMd5(content.data(), content.size());
+        std::transform(md5.begin(), md5.end(), md5.begin(), [](unsigned char c) { return std::tolower(c); });
+        return md5;
+    }
+
+    // Row without hash cannot be checked, so any file is trusted for it
+    bool matchesMd5(const std::string& content, const std::string& md5) {
+        return md5.empty() || osuFileMd5(content) == md5;
+    }
+
+    void storeOsuFile(int64_t id, const std::string& md5, const std::string& content) {
+        drogon::orm::DbClientPtr db = drogon::app().getDbClient();
+
+        db->execSqlAsync(
+            "INSERT INTO osu_files (beatmap_id, md5, content) VALUES (?, ?, ?) ON DUPLICATE KEY UPDATE md5 = VALUES(md5), content = VALUES(content);",
+            [](const drogon::orm::Result&) {},
+            [](const drogon::orm::DrogonDbException&) {},
+            id, md5, content
+        );
+    }
+
+    void serveOsuFile(int64_t id, const std::string& md5, std::string&& content, const std::function<void(OsuFileResult&&)>& callback) {
+        std::shared_ptr<const CachedOsuFile> cached = osuFileCache_.insert(id, { md5, std::move(content) });
+        callback({ drogon::k200OK, std::shared_ptr<const std::string> { cached, &cached->content }, "" });
+    }
+
+    void fetchOsuFile(int64_t id, const std::string& md5, std::function<void(OsuFileResult&&)>&& callback) {
+        // Same price as in /b/ route
+        if (!hanaru::verifyRateLimit(10)) {
+            callback({ drogon::k429TooManyRequests, nullptr, "rate limit, please wait 1 second" });
+            return;
+        }
+
+        hanaru::downloader::downloadOsuFile(id, [id, md5, callback = std::move(callback)](std::tuple<drogon::HttpStatusCode, std::string, std::string>&& result) {
+            auto& [code, content, error] = result;
+
+            if (code != drogon::k200OK) {
+                callback({ code, nullptr, std::move(error) });
+                return;
+            }
+
+            // Stored metadata is older than beatmap on osu!, it's refreshed so next request gets file that matches it
+            if (!matchesMd5(content, md5)) {
+                hanaru::downloader::downloadBeatmap(id, [](std::tuple<Json::Value, drogon::HttpStatusCode>&&) {}, hanaru::Priority::Background);
+                callback({ drogon::k503ServiceUnavailable, nullptr, "beatmap was updated on osu!, please try again later" });
+                return;
+            }
+
+            storeOsuFile(id, md5, content);
+            serveOsuFile(id, md5, std::move(content), callback);
+        });
+    }
+
+    // Archive might be older than difficulty, then file is fetched from osu!
+    void extractOsuFile(int64_t id, int64_t beatmapsetId, const std::string& md5, std::function<void(OsuFileResult&&)>&& callback) {
+        hanaru::downloader::downloadMap(beatmapsetId, [id, md5, callback = std::move(callback)](std::tuple<drogon::HttpStatusCode, std::shared_ptr<const hanaru::Beatmap>, std::string>&& result) mutable {
+            auto& [code, beatmap, error] = result;
+
+            if (beatmap == nullptr) {
+                fetchOsuFile(id, md5, std::move(callback));
+                return;
+            }
+
+            // Extracting and hashing every difficulty is too heavy for event loop
+            hanaru::storage::runTask([id, md5, beatmap = std::move(beatmap), callback = std::move(callback)]() mutable {
+                for (const hanaru::ZipEntry& entry : beatmap->entries()) {
+                    if (!hanaru::osu_file::isOsuFile(entry.name)) {
+                        continue;
+                    }
+
+                    std::optional<std::string> osuFile = hanaru::zip::extract(beatmap->content(), entry);
+                    if (!osuFile.has_value() || md5.empty() || osuFileMd5(osuFile.value()) != md5) {
+                        continue;
+                    }
+
+                    storeOsuFile(id, md5, osuFile.value());
+                    serveOsuFile(id, md5, std::move(osuFile.value()), callback);
+                    return;
+                }
+
+                fetchOsuFile(id, md5, std::move(callback));
+            });
+        });
+    }
+
+    void findOsuFile(int64_t id, int64_t beatmapsetId, const std::string& md5, std::function<void(OsuFileResult&&)>&& callback) {
+        // Difficulty might be updated since file was cached, then it's looked up again
+        if (auto cached = osuFileCache_.find(id); cached != nullptr && (md5.empty() || cached->md5 == md5)) {
+            callback({ drogon::k200OK, std::shared_ptr<const std::string> { cached, &cached->content }, "" });
+            return;
+        }
+
+        drogon::orm::DbClientPtr db = drogon::app().getDbClient();
+
+        db->execSqlAsync(
+            "SELECT md5, content FROM osu_files WHERE beatmap_id = ?;",
+            [id, beatmapsetId, md5, callback](const drogon::orm::Result& result) mutable {
+                if (!result.empty() && result[0]["md5"].as<std::string>() == md5) {
+                    serveOsuFile(id, md5, result[0]["content"].as<std::string>(), callback);
+                    return;
+                }
+
+                // Without hash there is no way to find difficulty in archive
+                if (!md5.empty() && (hanaru::storage::find(beatmapsetId) != nullptr || hanaru::storage::hasFile(beatmapsetId))) {
+                    extractOsuFile(id, beatmapsetId, md5, std::move(callback));
+                    return;
+                }
+
+                fetchOsuFile(id, md5, std::move(callback));
+            },
+            [callback](const drogon::orm::DrogonDbException&) {
+                callback({ drogon::k500InternalServerError, nullptr, "something went wrong, please report me!" });
+            },
+            id
+        );
+    }
+
+}
+
+namespace hanaru {
+
+    void difficulty_store::getOsuFile(int64_t id, std::function<void(std::tuple<drogon::HttpStatusCode, std::shared_ptr<const std::string>, std::string>&&)>&& callback) {
+        if (!verifyRateLimit(1)) {
+            callback({ drogon::k429TooManyRequests, nullptr, "rate limit, please try again" });
+            return;
+        }
+
+        drogon::orm::DbClientPtr db = drogon::app().getDbClient();
+
+        db->execSqlAsync(
+            "SELECT beatmapset_id, beatmap_md5 FROM beatmaps WHERE beatmap_id = ? LIMIT 1;",
+            [id, callback](const drogon::orm::Result& result) mutable {
+                if (!result.empty()) {
+                    detail::findOsuFile(id, result[0]["beatmapset_id"].as<int64_t>(), result[0]["beatmap_md5"].as<std::string>(), std::move(callback));
+                    return;
+                }
+
+                // Unknown difficulty is looked up first, so file can be checked against its hash
+                if (!verifyRateLimit(10)) {
+                    callback({ drogon::k429TooManyRequests, nullptr, "rate limit, please wait 1 second" });
+                    return;
+                }
+
+                downloader::downloadBeatmap(id, [id, callback = std::move(callback)](std::tuple<Json::Value, drogon::HttpStatusCode>&& result) mutable {
+                    const auto& [beatmap, code] = result;
+
+                    if (code == drogon::k404NotFound) {
+                        callback({ code, nullptr, "beatmap doesn't exist on osu! servers" });
+                        return;
+                    }
+
+                    if (code != drogon::k200OK) {
+                        callback({ code, nullptr, "osu! is unavailable right now, please try again later" });
+                        return;
+                    }
+
+                    detail::findOsuFile(id, beatmap["beatmapset_id"].asInt64(), beatmap["beatmap_md5"].asString(), std::move(callback));
+                });
+            },
+            [callback](const drogon::orm::DrogonDbException&) {
+                callback({ drogon::k500InternalServerError, nullptr, "something went wrong, please report me!" });
+            },
+            id
+        );
+    }
+
+}
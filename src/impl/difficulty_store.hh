@@ -0,0 +1,21 @@
+#pragma once
+
+#include <drogon/HttpAppFramework.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <tuple>
+
+namespace hanaru {
+
+    namespace difficulty_store {
+
+        // Returns .osu file of single difficulty, checked against `beatmap_md5` of its row in `beatmaps`.
+        // File is taken from `osu_files` table, then from stored archive of beatmapset, then from osu!, every file that was found is kept in `osu_files` and in memory.
+        // On success file is not null, otherwise string contains reason of failure
+        void getOsuFile(int64_t id, std::function<void(std::tuple<drogon::HttpStatusCode, std::shared_ptr<const std::string>, std::string>&&)>&& callback);
+
+    }
+
+}
@@ -1,452 +1,1752 @@
 #include "downloader.hh"
 
+#include "api_key.hh"
 #include "authorization.hh"
+#include "budget.hh"
+#include "circuit_breaker.hh"
+#include "map_stream.hh"
+#include "osu_api.hh"
+#include "osu_file.hh"
+#include "scheduler.hh"
+#include "single_flight.hh"
 #include "utils.hh"
 
 #include <drogon/HttpAppFramework.h>
 #include <drogon/HttpClient.h>
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
 #include <fstream>
 #include <iomanip>
+#include <optional>
 
 #include "../thirdparty/curler.hh"
 
 namespace detail {
 
-    std::string username_ {};
-    std::string password_ {};
-    std::string apiKey_ {};
-    std::string xsrfToken_ {};
-    std::string sessionToken_ {};
-    std::atomic_bool valid_ { false };
+    // osu! API limits keys per minute, so key that was throttled is back quickly, but key that was rejected is most likely revoked
+    constexpr std::chrono::seconds apiKeyThrottleCooldown = std::chrono::minutes(1);
+    constexpr std::chrono::seconds apiKeyRejectCooldown = std::chrono::minutes(15);
+
+    std::mutex apiKeysMutex_ {};
+    std::vector<std::shared_ptr<hanaru::ApiKey>> apiKeys_ {};
+    size_t nextApiKey_ = 0;
+    size_t apiPipeliningDepth_ = 1;
 
     curl::Factory factory_ {};
-    curl::Builder authBuilder_ = factory_.createRequest("https://osu.ppy.sh");
-    std::mutex reAuthMutex_ {};
 
-    void auth() {
-        if (valid_) {
-            return;
+    // osu! asks to wait 15 minutes after rate limiting account
+    constexpr std::chrono::seconds sessionCooldown = std::chrono::minutes(15);
+    // In seconds, how often sessions that failed to log in are trying again
+    constexpr double sessionRestoreInterval = 300.0;
+
+    std::mutex sessionsMutex_ {};
+    std::vector<std::shared_ptr<hanaru::Authorization>> sessions_ {};
+    size_t nextSession_ = 0;
+
+    // Web downloads, API and .osu files are limited by osu! separately, so ban of one shouldn't stop another
+    hanaru::CircuitBreaker downloadBreaker_ { "osu! downloads" };
+    hanaru::CircuitBreaker apiBreaker_ { "osu! API" };
+    hanaru::CircuitBreaker osuFileBreaker_ { "osu! files" };
+
+    using MapResult = std::tuple<drogon::HttpStatusCode, std::shared_ptr<const hanaru::Beatmap>, std::string>;
+    hanaru::SingleFlight<int64_t, MapResult> mapsInFlight_ {};
+
+    // Waiter of beatmapset that can receive archive while it's being downloaded
+    class MapWaiter {
+    public:
+        std::function<void(MapResult&&)> callback {};
+        std::function<void(std::shared_ptr<hanaru::MapStream>)> onStream {};
+        std::atomic_bool streaming = false;
+    };
+
+    // Prefetch that is limited in speed cannot be streamed, so client that asks for beatmapset in the meantime takes it over
+    class PrefetchFlight {
+    public:
+        std::shared_ptr<std::atomic_bool> cancelled = std::make_shared<std::atomic_bool>(false);
+        // Set by whoever completes flight, either prefetch itself or client that took it over
+        std::atomic_bool claimed = false;
+    };
+
+    std::mutex prefetchesMutex_ {};
+    std::unordered_map<int64_t, std::shared_ptr<PrefetchFlight>> prefetches_ {};
+
+    // Returns true if prefetch of beatmapset was aborted, then caller becomes leader of its flight
+    bool takeOverPrefetch(int64_t id) {
+        std::shared_ptr<PrefetchFlight> flight = nullptr;
+
+        {
+            std::unique_lock<std::mutex> lock { prefetchesMutex_ };
+
+            const auto it = prefetches_.find(id);
+            if (it == prefetches_.end()) {
+                return false;
+            }
+
+            flight = std::move(it->second);
+            prefetches_.erase(it);
+        }
+
+        // Prefetch is already done and completes flight by itself
+        if (flight->claimed.exchange(true)) {
+            return false;
+        }
+
+        *flight->cancelled = true;
+        return true;
+    }
+
+    std::mutex streamsMutex_ {};
+    std::unordered_map<int64_t, std::shared_ptr<hanaru::MapStream>> streams_ {};
+    std::unordered_map<int64_t, std::vector<std::shared_ptr<MapWaiter>>> streamWaiters_ {};
+
+    // In seconds, how often downloads are checked for clients that are still waiting for them
+    constexpr double interestCheckInterval = 1.0;
+
+    // Every client that waits for beatmapset which is being downloaded, background jobs are never cancelled
+    std::mutex interestMutex_ {};
+    std::unordered_map<int64_t, std::vector<hanaru::Cancellation>> interest_ {};
+
+    using ApiResult = std::tuple<Json::Value, drogon::HttpStatusCode>;
+    hanaru::SingleFlight<int64_t, ApiResult> beatmapsInFlight_ {};
+    hanaru::SingleFlight<int64_t, ApiResult> beatmapsetsInFlight_ {};
+
+    // Columns of `beatmaps` that are filled from osu! API, in the same order as `beatmapValues`
+    constexpr std::array<const char*, 26> beatmapColumns_ = {
+        "beatmap_id", "beatmapset_id", "beatmap_md5", "mode",
+        "artist", "title", "difficulty_name", "creator",
+        "count_normal", "count_slider", "count_spinner", "max_combo",
+        "ranked_status", "creating_date", "bpm", "hit_length",
+        "cs", "ar", "od", "hp",
+        "difficulty_std", "difficulty_taiko", "difficulty_ctb", "difficulty_mania",
+        "latest_update", "checked_at"
+    };
+
+    std::string beatmapColumns() {
+        std::string columns = "(";
+
+        for (const char* column : beatmapColumns_) {
+            columns.append(column).append(", ");
+        }
+
+        columns.resize(columns.size() - 2);
+        columns.push_back(')');
+        return columns;
+    }
+
+    std::string beatmapPlaceholders() {
+        std::string placeholders = "(";
+
+        for (size_t i = 0; i < beatmapColumns_.size(); i++) {
+            placeholders.append("?, ");
+        }
+
+        placeholders.resize(placeholders.size() - 2);
+        placeholders.push_back(')');
+        return placeholders;
+    }
+
+    // Updates every column on conflict, except status of beatmaps that was freezed by hand
+    std::string beatmapUpdates() {
+        std::string updates {};
+
+        for (const char* column : beatmapColumns_) {
+            const std::string name = column;
+
+            if (name == "beatmap_id") {
+                continue;
+            }
+
+            if (name == "ranked_status") {
+                updates.append("ranked_status = IF(ranked_status_freezed = 1, ranked_status, VALUES(ranked_status)), ");
+                continue;
+            }
+
+            updates.append(name).append(" = VALUES(").append(name).append("), ");
+        }
+
+        updates.resize(updates.size() - 2);
+        return updates;
+    }
+
+    // Converts single beatmap from osu! API into row of `beatmaps`
+    std::vector<std::string> beatmapValues(const hanaru::ApiBeatmap& beatmap) {
+        std::array<std::string, 4> difficulties = { "0", "0", "0", "0" };
+
+        // Unknown modes are stored as osu!standard
+        const size_t modeIndex = beatmap.mode >= 0 && beatmap.mode <= 3 ? static_cast<size_t>(beatmap.mode) : 0;
+        difficulties[modeIndex] = std::to_string(beatmap.difficulty);
+
+        // Beatmaps that were never approved are stored as pending
+        const int32_t rankedStatus = beatmap.approvedDate.empty() ? 0 : beatmap.rankedStatus;
+        const int64_t lastUpdate = beatmap.lastUpdate.empty() ? hanaru::timeFromEpoch() : hanaru::stringToTime(beatmap.lastUpdate);
+
+        return {
+            std::to_string(beatmap.beatmapId), std::to_string(beatmap.beatmapsetId), beatmap.md5, std::to_string(modeIndex),
+            beatmap.artist, beatmap.title, beatmap.version, beatmap.creator,
+            std::to_string(beatmap.countNormal), std::to_string(beatmap.countSlider), std::to_string(beatmap.countSpinner), std::to_string(beatmap.maxCombo),
+            std::to_string(rankedStatus), std::to_string(lastUpdate), std::to_string(std::llround(beatmap.bpm)), std::to_string(beatmap.hitLength),
+            std::to_string(beatmap.cs), std::to_string(beatmap.ar), std::to_string(beatmap.od), std::to_string(beatmap.hp),
+            difficulties[0], difficulties[1], difficulties[2], difficulties[3],
+            std::to_string(lastUpdate), std::to_string(hanaru::timeFromEpoch())
+        };
+    }
+
+    // Whole response is written by single statement, rows that already exist are updated (status of freezed ones is left untouched)
+    void saveBeatmaps(const std::vector<hanaru::ApiBeatmap>& beatmaps, std::function<void(bool)>&& callback) {
+        if (beatmaps.empty()) {
+            callback(true);
+            return;
+        }
+
+        drogon::orm::DbClientPtr db = drogon::app().getDbClient();
+        std::string query = "INSERT INTO beatmaps " + beatmapColumns() + " VALUES ";
+
+        for (size_t i = 0; i < beatmaps.size(); i++) {
+            query.append(i == 0 ? "" : ", ").append(beatmapPlaceholders());
+        }
+
+        query.append(" ON DUPLICATE KEY UPDATE ").append(beatmapUpdates()).append(";");
+
+        drogon::orm::internal::SqlBinder binder = *db << std::move(query);
+        for (const hanaru::ApiBeatmap& beatmap : beatmaps) {
+            for (std::string& value : beatmapValues(beatmap)) {
+                binder << std::move(value);
+            }
+        }
+
+        binder
+            >> [callback](const drogon::orm::Result&) { callback(true); }
+            >> [callback](const drogon::orm::DrogonDbException& ex) {
+                LOG_WARN << "Failed to save beatmaps: " << ex.base().what();
+                callback(false);
+            };
+    }
+
+    // Every event loop keeps own persistent connection to osu!, so lookups don't pay for DNS, TCP and TLS handshake every time
+    drogon::HttpClientPtr apiClient() {
+        thread_local drogon::HttpClientPtr client = nullptr;
+
+        if (client == nullptr) {
+            trantor::EventLoop* loop = trantor::EventLoop::getEventLoopOfCurrentThread();
+
+            client = drogon::HttpClient::newHttpClient("https://osu.ppy.sh", loop != nullptr ? loop : drogon::app().getLoop());
+            client->setPipeliningDepth(apiPipeliningDepth_);
+            client->enableCookies(false);
+        }
+
+        return client;
+    }
+
+    std::shared_ptr<hanaru::ApiKey> acquireApiKey() {
+        std::unique_lock<std::mutex> lock { apiKeysMutex_ };
+        return hanaru::acquireLargestBudget(apiKeys_, nextApiKey_);
+    }
+
+    bool hasAvailableApiKey() {
+        std::unique_lock<std::mutex> lock { apiKeysMutex_ };
+        return hanaru::hasAvailableBudget(apiKeys_);
+    }
+
+    // Callback receives decoded beatmaps with 200, or status code that must be returned to client.
+    // Body is decoded straight into beatmaps, so JSON tree of response is never built.
+    void getBeatmaps(
+        std::vector<std::pair<std::string, std::string>>&& parameters,
+        hanaru::Priority priority,
+        std::function<void(drogon::HttpStatusCode, std::vector<hanaru::ApiBeatmap>&&)>&& callback
+    ) {
+        if (apiBreaker_.retryAfter() != 0) {
+            callback(drogon::k503ServiceUnavailable, {});
+            return;
+        }
+
+        hanaru::scheduler::schedule(priority,
+            [parameters = std::move(parameters), callback](hanaru::scheduler::SlotPtr slot) {
+                if (!apiBreaker_.allow()) {
+                    callback(drogon::k503ServiceUnavailable, {});
+                    return;
+                }
+
+                // Key is taken only once request is going to be sent, so lookups stopped by breaker don't spend its budget.
+                // Every key is out of budget or out of rotation
+                std::shared_ptr<hanaru::ApiKey> apiKey = acquireApiKey();
+                if (apiKey == nullptr) {
+                    apiBreaker_.recordSkipped();
+                    callback(drogon::k503ServiceUnavailable, {});
+                    return;
+                }
+
+                drogon::HttpRequestPtr request = drogon::HttpRequest::newHttpRequest();
+                drogon::HttpClientPtr client = apiClient();
+
+                request->setPath("/api/get_beatmaps");
+                request->setParameter("k", apiKey->key());
+                for (const auto& [key, value] : parameters) {
+                    request->setParameter(key, value);
+                }
+
+                // Slot is released together with this callback, request that is slower than lookup deadline is useless for client anyway
+                client->sendRequest(request, [callback, apiKey, slot = std::move(slot)](drogon::ReqResult result, const drogon::HttpResponsePtr& response) {
+                    if (result != drogon::ReqResult::Ok) {
+                        apiBreaker_.recordFailure();
+                        callback(drogon::k404NotFound, {});
+                        return;
+                    }
+
+                    // Only this key is slowed down while others still have budget, osu! API as a whole is stopped once every key is throttled
+                    if (response->statusCode() == drogon::k429TooManyRequests) {
+                        apiKey->throttle(apiKeyThrottleCooldown);
+
+                        if (hasAvailableApiKey()) {
+                            apiBreaker_.recordSuccess();
+                        }
+                        else {
+                            apiBreaker_.recordThrottled();
+                        }
+
+                        callback(drogon::k503ServiceUnavailable, {});
+                        return;
+                    }
+
+                    if (response->statusCode() == drogon::k401Unauthorized || response->statusCode() == drogon::k403Forbidden) {
+                        LOG_WARN << "osu! API rejected key " << apiKey->key().substr(0, 4) << "..., it won't be used for " << apiKeyRejectCooldown.count() << " seconds";
+                        apiKey->throttle(apiKeyRejectCooldown);
+                        apiBreaker_.recordSuccess();
+                        callback(drogon::k503ServiceUnavailable, {});
+                        return;
+                    }
+
+                    if (response->statusCode() >= drogon::k500InternalServerError) {
+                        apiBreaker_.recordFailure();
+                        callback(drogon::k503ServiceUnavailable, {});
+                        return;
+                    }
+
+                    apiBreaker_.recordSuccess();
+
+                    std::optional<std::vector<hanaru::ApiBeatmap>> beatmaps = hanaru::osu_api::parseBeatmaps(response->body());
+                    if (!beatmaps.has_value()) {
+                        LOG_WARN << "osu! API sent something that isn't list of beatmaps";
+                        callback(drogon::k404NotFound, {});
+                        return;
+                    }
+
+                    callback(drogon::k200OK, std::move(beatmaps.value()));
+                }, static_cast<double>(hanaru::deadlines::lookup()));
+            },
+            [callback]() { callback(drogon::k503ServiceUnavailable, {}); }
+        );
+    }
+
+    std::shared_ptr<hanaru::Authorization> acquireSession() {
+        std::unique_lock<std::mutex> lock { sessionsMutex_ };
+        return hanaru::acquireLargestBudget(sessions_, nextSession_);
+    }
+
+    bool hasAvailableSession() {
+        std::unique_lock<std::mutex> lock { sessionsMutex_ };
+        return hanaru::hasAvailableBudget(sessions_);
+    }
+
+    // Returns false if every session failed to log in
+    bool hasUsableSession() {
+        std::unique_lock<std::mutex> lock { sessionsMutex_ };
+        return std::any_of(sessions_.begin(), sessions_.end(), [](const auto& session) { return session->state() != hanaru::Authorization::State::LoggedOut; });
+    }
+
+    // Download that waits for session to log in, answered either by session or by cancellation, whichever comes first
+    class ParkedDownload {
+    public:
+        std::function<void(std::shared_ptr<hanaru::Authorization>)> callback {};
+        std::shared_ptr<std::atomic_bool> cancelled {};
+        std::atomic_bool answered = false;
+    };
+
+    void answerParked(const std::shared_ptr<ParkedDownload>& parked, std::shared_ptr<hanaru::Authorization> session) {
+        if (parked->answered.exchange(true)) {
+            return;
+        }
+
+        // Callback holds transfer slot, so it must be released right after it's called, not when session is done logging in
+        std::function<void(std::shared_ptr<hanaru::Authorization>)> callback = std::move(parked->callback);
+        parked->callback = nullptr;
+        callback(std::move(session));
+    }
+
+    // Client that left doesn't have to wait until session logs in
+    void watchParked(std::shared_ptr<ParkedDownload> parked) {
+        drogon::app().getLoop()->runAfter(interestCheckInterval, [parked = std::move(parked)]() mutable {
+            if (parked->answered) {
+                return;
+            }
+
+            if (*parked->cancelled) {
+                answerParked(parked, nullptr);
+                return;
+            }
+
+            watchParked(std::move(parked));
+        });
+    }
+
+    // Calls callback with acquired session, or with nullptr if there is no session that can download.
+    // If every session is logging in right now, download waits for one of them instead of failing, or until token is raised.
+    void withSession(std::function<void(std::shared_ptr<hanaru::Authorization>)>&& callback, std::shared_ptr<std::atomic_bool> cancelled = nullptr) {
+        if (std::shared_ptr<hanaru::Authorization> session = acquireSession()) {
+            callback(std::move(session));
+            return;
+        }
+
+        std::shared_ptr<hanaru::Authorization> pending = nullptr;
+
+        {
+            std::unique_lock<std::mutex> lock { sessionsMutex_ };
+            for (const auto& session : sessions_) {
+                if (session->state() == hanaru::Authorization::State::LoggingIn) {
+                    pending = session;
+                    break;
+                }
+            }
+        }
+
+        if (pending == nullptr) {
+            callback(nullptr);
+            return;
+        }
+
+        auto parked = std::make_shared<ParkedDownload>();
+        parked->callback = std::move(callback);
+        parked->cancelled = std::move(cancelled);
+
+        if (parked->cancelled != nullptr) {
+            watchParked(parked);
+        }
+
+        pending->whenReady([pending, parked](bool ready) {
+            if (parked->answered) {
+                return;
+            }
+
+            // Another download could take last download from budget while this one was waiting
+            answerParked(parked, ready && pending->acquire() ? pending : acquireSession());
+        });
+    }
+
+    // Sessions that failed to log in are retried periodically
+    void restoreSessions() {
+        std::unique_lock<std::mutex> lock { sessionsMutex_ };
+
+        for (const auto& session : sessions_) {
+            if (session->state() == hanaru::Authorization::State::LoggedOut) {
+                session->reAuth();
+            }
+        }
+    }
+
+    // Archive transfer that sends less than that (in bytes per second) for given amount of seconds is stalled, it's aborted so it doesn't hold its slot forever
+    constexpr uint64_t stalledSpeed = 1024;
+    constexpr long stalledTime = 30;
+
+    curl::Builder createDownloadRequest(int64_t id, hanaru::Authorization& session) {
+        const std::string beatmapsetId = std::to_string(id);
+
+        curl::Builder builder = factory_.createRequest("https://osu.ppy.sh");
+        builder
+            .setPath("/beatmapsets/" + beatmapsetId + "/download")
+            .setParameter("noVideo", "1")
+            .addHeader("Alt-Used", "osu.ppy.sh")
+            .addHeader("Connection", "keep-alive")
+            .setUserAgent(HANARU_USER_AGENT)
+            .setReferer("https://osu.ppy.sh/beatmapsets/" + beatmapsetId)
+            .setLowSpeedLimit(stalledSpeed, stalledTime);
+        session.authorize(builder);
+
+        return builder;
+    }
+
+    // Archive source that is used when osu! fails or is too slow, `{id}` in path is replaced by id of beatmapset
+    class Mirror {
+    public:
+        std::string host {};
+        std::string path {};
+    };
+
+    std::vector<Mirror> mirrors_ {};
+    // In seconds, 0 means that mirrors are used only after osu! failed
+    double hedgeDelay_ = 0.0;
+
+    // Download of single beatmapset from osu! and mirrors, first source that starts sending valid archive wins and others are aborted
+    class MapRace {
+    public:
+        int64_t id = 0;
+        std::filesystem::path beatmapPath {};
+        std::function<void(MapResult&&)> callback {};
+        // Transfer slot is released when every request of race is destroyed
+        hanaru::scheduler::SlotPtr slot {};
+
+        std::mutex mutex {};
+        size_t nextMirror = 0;
+        size_t running = 0;
+        // osu! is source 0, mirrors are counted from 1
+        std::optional<size_t> winner {};
+        // Set once winner is known or every source failed
+        bool finished = false;
+        // Returned if every source failed, error of osu! is preferred since it's the most accurate one
+        std::optional<MapResult> error {};
+        std::shared_ptr<hanaru::MapStream> stream {};
+        // Set when archive cannot be written on disk, so winner's transfer is aborted
+        bool saveFailed = false;
+        // Raised when nobody waits for archive anymore, every request of race is aborted by curl
+        std::shared_ptr<std::atomic_bool> cancelled {};
+    };
+
+    MapResult cancelledResult() {
+        return { drogon::k503ServiceUnavailable, nullptr, "download was cancelled, because nobody waits for it" };
+    }
+
+    std::string unavailableMessage(hanaru::CircuitBreaker& breaker = downloadBreaker_) {
+        return "osu! is unavailable right now, please try again in " + std::to_string(breaker.retryAfter()) + " seconds";
+    }
+
+    // Lets circuit breaker and session know how osu! responded
+    void recordResponse(hanaru::Authorization& session, curl::Response& r) {
+        if (r.code == curl::StatusCode::Values::TooManyRequests) {
+            // Limit is per account, so osu! as a whole is considered throttled only when every account is
+            session.throttle(sessionCooldown);
+            LOG_WARN << "Account " << session.username() << " was rate limited by osu!";
+
+            if (!hasAvailableSession()) {
+                downloadBreaker_.recordThrottled();
+            }
+            else {
+                downloadBreaker_.recordSuccess();
+            }
+        }
+        else if (r.code >= curl::StatusCode::Values::InternalServerError) {
+            downloadBreaker_.recordFailure();
+        }
+        else {
+            downloadBreaker_.recordSuccess();
+        }
+    }
+
+    // Handles every response that doesn't contain archive, returns true only if response is valid osz file
+    bool verifyDownload(int64_t id, const std::filesystem::path& beatmapPath, hanaru::Authorization& session, curl::Response& r, const std::function<void(MapResult&&)>& callback) {
+        recordResponse(session, r);
+
+        switch (r.code) {
+            case curl::StatusCode::Values::Forbidden:
+            case curl::StatusCode::Values::Unauthorized: {
+                session.reAuth();
+
+                callback({ drogon::k401Unauthorized, nullptr, "our downloader become unauthorized, please try again later" });
+                return false;
+            }
+            case curl::StatusCode::Values::NotFound: {
+                std::ofstream beatmapFile;
+                beatmapFile.open(beatmapPath);
+                beatmapFile.close();
+                hanaru::storage::commitFile(id, beatmapPath);
+
+                callback({ drogon::k404NotFound, nullptr, "beatmapset doesn't exist on osu! servers or this beatmapset was banned" });
+                return false;
+            }
+            case curl::StatusCode::Values::TooManyRequests: {
+                callback({ drogon::k429TooManyRequests, nullptr, "downloader was limited by osu! system, please try again later" });
+                return false;
+            }
+            case curl::StatusCode::Values::OK: {
+                if (r.body.empty() || r.body.find("PK\x03\x04") != 0) {
+                    LOG_WARN << "Response was not valid osz file: " << (r.body.size() > 100 ? r.body.substr(0, 100) : r.body);
+                    callback({ drogon::k422UnprocessableEntity, nullptr, "response from osu! wasn't valid osz file" });
+                    return false;
+                }
+
+                session.update(r);
+                return true;
+            }
+            default: {
+                callback({ drogon::k503ServiceUnavailable, nullptr, "response from osu! wasn't valid" });
+                return false;
+            }
+        }
+    }
+
+    void publishStream(int64_t id, const std::shared_ptr<hanaru::MapStream>& stream) {
+        std::vector<std::shared_ptr<MapWaiter>> waiters {};
+
+        {
+            std::unique_lock<std::mutex> lock { streamsMutex_ };
+            streams_[id] = stream;
+
+            const auto it = streamWaiters_.find(id);
+            if (it != streamWaiters_.end()) {
+                waiters = std::move(it->second);
+                streamWaiters_.erase(it);
+            }
+        }
+
+        for (const auto& waiter : waiters) {
+            waiter->streaming = true;
+            waiter->onStream(stream);
+        }
+    }
+
+    void retireStream(int64_t id) {
+        std::unique_lock<std::mutex> lock { streamsMutex_ };
+        streams_.erase(id);
+        streamWaiters_.erase(id);
+    }
+
+    void registerInterest(int64_t id, const hanaru::Cancellation& cancellation) {
+        std::unique_lock<std::mutex> lock { interestMutex_ };
+        interest_[id].push_back(cancellation);
+    }
+
+    void forgetInterest(int64_t id) {
+        std::unique_lock<std::mutex> lock { interestMutex_ };
+        interest_.erase(id);
+    }
+
+    bool isWanted(int64_t id) {
+        std::unique_lock<std::mutex> lock { interestMutex_ };
+
+        const auto it = interest_.find(id);
+        if (it == interest_.end()) {
+            return true;
+        }
+
+        return std::any_of(it->second.begin(), it->second.end(), [](const hanaru::Cancellation& cancellation) { return !cancellation.cancelled(); });
+    }
+
+    // Raises flag once nobody waits for beatmapset anymore, stops when download is finished and flag is destroyed
+    void watchInterest(int64_t id, std::weak_ptr<std::atomic_bool> cancelled) {
+        drogon::app().getLoop()->runAfter(interestCheckInterval, [id, cancelled = std::move(cancelled)]() mutable {
+            std::shared_ptr<std::atomic_bool> flag = cancelled.lock();
+            if (flag == nullptr) {
+                return;
+            }
+
+            if (!isWanted(id)) {
+                LOG_INFO << "Every client that waited for beatmapset " << id << " is gone, aborting download";
+                *flag = true;
+                return;
+            }
+
+            watchInterest(id, std::move(cancelled));
+        });
+    }
+
+    std::vector<std::string> beatmapValues(const hanaru::OsuMetadata& metadata) {
+        std::array<std::string, 4> difficulties = { "0", "0", "0", "0" };
+        const size_t modeIndex = metadata.mode >= 0 && metadata.mode <= 3 ? static_cast<size_t>(metadata.mode) : 0;
+
+        // Star rating cannot be calculated from .osu file, so row is marked with unknown status and is never checked.
+        // Refresher handles unknown status as pending, so such rows are refreshed only together with pending ones, but before them
+        return {
+            std::to_string(metadata.beatmapId), std::to_string(metadata.beatmapsetId), metadata.md5, std::to_string(modeIndex),
+            metadata.artist, metadata.title, metadata.version, metadata.creator,
+            std::to_string(metadata.countNormal), std::to_string(metadata.countSlider), std::to_string(metadata.countSpinner), "0",
+            std::to_string(static_cast<int32_t>(hanaru::RankedStatus::Unknown)), "0", std::to_string(metadata.bpm), std::to_string(metadata.hitLength),
+            std::to_string(metadata.cs), std::to_string(metadata.ar), std::to_string(metadata.od), std::to_string(metadata.hp),
+            difficulties[0], difficulties[1], difficulties[2], difficulties[3],
+            "0", "0"
+        };
+    }
+
+    // Fills `beatmaps` from .osu files of downloaded archive, so lookups of its difficulties work without osu! API.
+    // Rows from osu! API are more complete, so with API keys nothing is indexed, and beatmapsets that already have rows are skipped.
+    // Once keys are configured, rows indexed before are replaced by upsert of `/b/` and `/s/` lookups (they treat such rows as misses) and of crawler.
+    void indexArchive(int64_t id, const std::shared_ptr<const hanaru::Beatmap>& beatmap) {
+        if (!apiKeys_.empty()) {
+            return;
+        }
+
+        drogon::orm::DbClientPtr db = drogon::app().getDbClient();
+
+        db->execSqlAsync(
+            "SELECT 1 FROM beatmaps WHERE beatmapset_id = ? LIMIT 1;",
+            [id, beatmap](const drogon::orm::Result& result) {
+                if (!result.empty()) {
+                    return;
+                }
+
+                // Extracting and hashing every difficulty is too heavy for event loop
+                hanaru::storage::runTask([id, beatmap]() {
+                    std::vector<hanaru::OsuMetadata> difficulties {};
+
+                    for (const hanaru::ZipEntry& entry : beatmap->entries()) {
+                        if (!hanaru::osu_file::isOsuFile(entry.name)) {
+                            continue;
+                        }
+
+                        const std::optional<std::string> osuFile = hanaru::zip::extract(beatmap->content(), entry);
+                        if (!osuFile.has_value()) {
+                            continue;
+                        }
+
+                        if (std::optional<hanaru::OsuMetadata> metadata = hanaru::osu_file::parseMetadata(osuFile.value())) {
+                            // Very old files don't have id of beatmapset
+                            metadata->beatmapsetId = id;
+                            difficulties.push_back(std::move(metadata.value()));
+                        }
+                    }
+
+                    if (difficulties.empty()) {
+                        return;
+                    }
+
+                    drogon::orm::DbClientPtr db = drogon::app().getDbClient();
+                    std::string query = "INSERT IGNORE INTO beatmaps " + beatmapColumns() + " VALUES ";
+
+                    for (size_t i = 0; i < difficulties.size(); i++) {
+                        query.append(i == 0 ? "" : ", ").append(beatmapPlaceholders());
+                    }
+
+                    query.push_back(';');
+
+                    drogon::orm::internal::SqlBinder binder = *db << std::move(query);
+                    for (const hanaru::OsuMetadata& metadata : difficulties) {
+                        for (std::string& value : beatmapValues(metadata)) {
+                            binder << std::move(value);
+                        }
+                    }
+
+                    binder >> [](const drogon::orm::Result&) {} >> [](const drogon::orm::DrogonDbException&) {};
+                });
+            },
+            [](const drogon::orm::DrogonDbException&) {},
+            id
+        );
+    }
+
+    // Token can be null, then download is never cancelled
+    void bufferMap(
+        int64_t id,
+        std::function<void(MapResult&&)>&& callback,
+        hanaru::scheduler::SlotPtr&& slot,
+        std::shared_ptr<std::atomic_bool> cancelled,
+        uint64_t maxSpeed = 0,
+        bool retried = false
+    );
+
+    // Sends request with another session once there is one, so user never sees that session has expired
+    void retryBufferMap(int64_t id, std::function<void(MapResult&&)>&& callback, hanaru::scheduler::SlotPtr&& slot, std::shared_ptr<std::atomic_bool>&& cancelled, uint64_t maxSpeed) {
+        drogon::app().getLoop()->queueInLoop([id, callback = std::move(callback), slot = std::move(slot), cancelled = std::move(cancelled), maxSpeed]() mutable {
+            bufferMap(id, std::move(callback), std::move(slot), std::move(cancelled), maxSpeed, true);
+        });
+    }
+
+    void sendBufferedRequest(
+        int64_t id,
+        std::function<void(MapResult&&)>&& callback,
+        hanaru::scheduler::SlotPtr&& slot,
+        std::shared_ptr<hanaru::Authorization>&& session,
+        std::shared_ptr<std::atomic_bool>&& cancelled,
+        uint64_t maxSpeed,
+        bool retried
+    ) {
+        const std::filesystem::path beatmapPath = hanaru::storage::resolvePath(id);
+        curl::Builder builder = createDownloadRequest(id, *session);
+        builder
+            .setMaxDownloadSpeed(maxSpeed)
+            .setCancellationToken(cancelled)
+            .onError([callback, slot, cancelled](curl::Response& r) {
+                // Aborted by us, so it says nothing about osu!
+                if (cancelled != nullptr && *cancelled) {
+                    callback(cancelledResult());
+                    return;
+                }
+
+                downloadBreaker_.recordFailure();
+                callback({ drogon::k500InternalServerError, nullptr, r.error });
+            })
+            .onComplete([id, beatmapPath, session, callback, slot, cancelled, maxSpeed, retried](curl::Response& r) mutable {
+                const bool expired = r.code == curl::StatusCode::Values::Unauthorized || r.code == curl::StatusCode::Values::Forbidden;
+                if (expired && !retried) {
+                    recordResponse(*session, r);
+                    session->reAuth();
+                    retryBufferMap(id, std::move(callback), std::move(slot), std::move(cancelled), maxSpeed);
+                    return;
+                }
+
+                if (!verifyDownload(id, beatmapPath, *session, r, callback)) {
+                    return;
+                }
+
+                std::string filename = hanaru::downloader::getFilenameFromLink(id, r.headers);
+
+                // Body is written before it's moved into memory cache
+                if (hanaru::storage::canWrite()) {
+                    hanaru::downloader::saveBeatmapToDB(id, filename);
+
+                    // Writing into temporary file first, so previous version of archive (if any) is replaced atomically
+                    std::filesystem::path temporaryPath = beatmapPath;
+                    temporaryPath += ".part";
+
+                    std::error_code ec {};
+                    if (r.saveToFile(temporaryPath.generic_string(), true)) {
+                        std::filesystem::rename(temporaryPath, beatmapPath, ec);
+                        hanaru::storage::commitFile(id, beatmapPath);
+                    }
+                }
+
+                const auto sBeatmap = hanaru::storage::insert(id, std::move(filename), std::move(r.body));
+                indexArchive(id, sBeatmap);
+
+                callback({ drogon::k200OK, sBeatmap, "" });
+            });
+
+        factory_.pushRequest(builder);
+    }
+
+    void bufferMap(
+        int64_t id,
+        std::function<void(MapResult&&)>&& callback,
+        hanaru::scheduler::SlotPtr&& slot,
+        std::shared_ptr<std::atomic_bool> cancelled,
+        uint64_t maxSpeed,
+        bool retried
+    ) {
+        std::shared_ptr<std::atomic_bool> token = cancelled;
+
+        withSession([id, callback = std::move(callback), slot = std::move(slot), cancelled = std::move(cancelled), maxSpeed, retried](std::shared_ptr<hanaru::Authorization> session) mutable {
+            if (cancelled != nullptr && *cancelled) {
+                callback(cancelledResult());
+                return;
+            }
+
+            if (session == nullptr) {
+                callback({ drogon::k503ServiceUnavailable, nullptr, "no downloader account is available right now, please try again later" });
+                return;
+            }
+
+            // Breaker could open while request was waiting for slot
+            if (!downloadBreaker_.allow()) {
+                callback({ drogon::k503ServiceUnavailable, nullptr, unavailableMessage() });
+                return;
+            }
+
+            sendBufferedRequest(id, std::move(callback), std::move(slot), std::move(session), std::move(cancelled), maxSpeed, retried);
+        }, std::move(token));
+    }
+
+    void publishRaceResult(const std::shared_ptr<MapRace>& race) {
+        std::shared_ptr<hanaru::MapStream> stream = race->stream;
+
+        if (!stream->finish(true)) {
+            race->callback({ drogon::k500InternalServerError, nullptr, "failed to save archive" });
+            return;
+        }
+
+        std::string name = stream->name();
+        hanaru::storage::commitFile(race->id, race->beatmapPath);
+        hanaru::downloader::saveBeatmapToDB(race->id, name);
+
+        // Waiters without stream and memory cache need whole archive, reading it inside of curl thread would stall other downloads
+        hanaru::storage::runTask([id = race->id, beatmapPath = race->beatmapPath, name, callback = race->callback]() mutable {
+            std::string contents = hanaru::storage::readFile(beatmapPath);
+
+            if (contents.empty()) {
+                callback({ drogon::k500InternalServerError, nullptr, "failed to read saved archive" });
+                return;
+            }
+
+            const auto sBeatmap = hanaru::storage::insert(id, std::move(name), std::move(contents));
+            indexArchive(id, sBeatmap);
+
+            callback({ drogon::k200OK, sBeatmap, "" });
+        });
+    }
+
+    void startMirror(const std::shared_ptr<MapRace>& race, size_t index);
+
+    // Lock of race must be held by caller, request itself is sent from event loop, because this can be called from curl thread
+    void launchMirror(const std::shared_ptr<MapRace>& race) {
+        const size_t index = race->nextMirror++;
+        race->running++;
+
+        drogon::app().getLoop()->queueInLoop([race, index]() { startMirror(race, index); });
+    }
+
+    // Called when source didn't send archive, next mirror is tried only when every other source failed as well
+    void failSource(const std::shared_ptr<MapRace>& race, MapResult&& result, bool fromOsu, bool canFallback) {
+        std::unique_lock<std::mutex> lock { race->mutex };
+        race->running--;
+
+        if (fromOsu || !race->error.has_value()) {
+            race->error = std::move(result);
+        }
+
+        if (race->finished) {
+            return;
+        }
+
+        // There is no reason to try other sources if nobody waits for archive
+        canFallback = canFallback && !*race->cancelled;
+
+        if (canFallback && race->running > 0) {
+            return;
+        }
+
+        if (canFallback && race->nextMirror < mirrors_.size()) {
+            launchMirror(race);
+            return;
+        }
+
+        race->finished = true;
+        MapResult error = std::move(*race->error);
+        lock.unlock();
+
+        race->callback(std::move(error));
+    }
+
+    // Aborts winner's transfer, error handler of source fails stream and every subscriber of it
+    bool abortSave(const std::shared_ptr<MapRace>& race) {
+        LOG_WARN << "Failed to save beatmapset " << race->id << " on disk, download is aborted";
+
+        std::unique_lock<std::mutex> lock { race->mutex };
+        race->saveFailed = true;
+        return false;
+    }
+
+    // Returns false if source lost the race or archive cannot be saved, so its transfer must be aborted
+    bool receiveChunk(const std::shared_ptr<MapRace>& race, size_t source, curl::Response& r, std::string_view chunk) {
+        std::unique_lock<std::mutex> lock { race->mutex };
+
+        if (race->winner == source) {
+            std::shared_ptr<hanaru::MapStream> stream = race->stream;
+            lock.unlock();
+
+            return stream->write(chunk) || abortSave(race);
+        }
+
+        if (race->finished) {
+            return false;
+        }
+
+        lock.unlock();
+
+        // Errors and redirects are small, so they are buffered as usual
+        r.body.append(chunk);
+
+        if (r.code != curl::StatusCode::Values::OK || r.body.size() < 4 || r.body.find("PK\x03\x04") != 0) {
+            return true;
+        }
+
+        lock.lock();
+
+        if (race->finished) {
+            return false;
+        }
+
+        race->winner = source;
+        race->finished = true;
+        race->stream = std::make_shared<hanaru::MapStream>(hanaru::downloader::getFilenameFromLink(race->id, r.headers), race->beatmapPath);
+
+        std::shared_ptr<hanaru::MapStream> stream = race->stream;
+        lock.unlock();
+
+        publishStream(race->id, stream);
+
+        const bool written = stream->write(r.body);
+        r.body.clear();
+        return written || abortSave(race);
+    }
+
+    // Returns true if error must be handled by source, false if source was aborted because it lost the race
+    bool receiveError(const std::shared_ptr<MapRace>& race, size_t source, const curl::Response& r) {
+        std::unique_lock<std::mutex> lock { race->mutex };
+
+        if (race->winner == source) {
+            std::shared_ptr<hanaru::MapStream> stream = race->stream;
+            const bool saveFailed = race->saveFailed;
+            lock.unlock();
+
+            stream->finish(false);
+            race->callback({ drogon::k500InternalServerError, nullptr, saveFailed ? "failed to save beatmapset" : r.error });
+            return false;
+        }
+
+        if (race->finished) {
+            race->running--;
+            return false;
+        }
+
+        return true;
+    }
+
+    // Returns true if source sent whole archive, false if it didn't send archive and race is still going
+    bool receiveComplete(const std::shared_ptr<MapRace>& race, size_t source, bool& lost) {
+        std::unique_lock<std::mutex> lock { race->mutex };
+        lost = false;
+
+        if (race->winner == source) {
+            return true;
+        }
+
+        if (race->finished) {
+            race->running--;
+            lost = true;
+        }
+
+        return false;
+    }
+
+    void startOsu(const std::shared_ptr<MapRace>& race, std::shared_ptr<hanaru::Authorization>&& session, bool retried);
+
+    // Sends request with another session once there is one, so user never sees that session has expired
+    void retryOsu(const std::shared_ptr<MapRace>& race) {
+        drogon::app().getLoop()->queueInLoop([race]() {
+            withSession([race](std::shared_ptr<hanaru::Authorization> session) {
+                {
+                    std::unique_lock<std::mutex> lock { race->mutex };
+
+                    // Mirror could win while session was logging in
+                    if (race->finished) {
+                        race->running--;
+                        return;
+                    }
+                }
+
+                if (*race->cancelled) {
+                    failSource(race, cancelledResult(), true, false);
+                    return;
+                }
+
+                if (session == nullptr) {
+                    failSource(race, { drogon::k401Unauthorized, nullptr, "our downloader become unauthorized, please try again later" }, true, true);
+                    return;
+                }
+
+                startOsu(race, std::move(session), true);
+            }, race->cancelled);
+        });
+    }
+
+    void startOsu(const std::shared_ptr<MapRace>& race, std::shared_ptr<hanaru::Authorization>&& session, bool retried) {
+        curl::Builder builder = createDownloadRequest(race->id, *session);
+        builder
+            .setCancellationToken(race->cancelled)
+            .onData([race, session](curl::Response& r, std::string_view chunk) {
+                if (receiveChunk(race, 0, r, chunk)) {
+                    return true;
+                }
+
+                // Mirror was faster or archive cannot be saved, but osu! still responded, so breaker and session must know about it
+                recordResponse(*session, r);
+                return false;
+            })
+            .onError([race](curl::Response& r) {
+                if (!receiveError(race, 0, r)) {
+                    return;
+                }
+
+                // Aborted by us, so it says nothing about osu!
+                if (*race->cancelled) {
+                    failSource(race, cancelledResult(), true, false);
+                    return;
+                }
+
+                downloadBreaker_.recordFailure();
+                failSource(race, { drogon::k500InternalServerError, nullptr, r.error }, true, true);
+            })
+            .onComplete([race, session, retried](curl::Response& r) {
+                bool lost = false;
+                if (receiveComplete(race, 0, lost)) {
+                    downloadBreaker_.recordSuccess();
+                    session->update(r);
+                    publishRaceResult(race);
+                    return;
+                }
+
+                if (lost) {
+                    recordResponse(*session, r);
+                    return;
+                }
+
+                const bool expired = r.code == curl::StatusCode::Values::Unauthorized || r.code == curl::StatusCode::Values::Forbidden;
+                if (expired && !retried) {
+                    recordResponse(*session, r);
+                    session->reAuth();
+                    retryOsu(race);
+                    return;
+                }
+
+                // Beatmapset that doesn't exist on osu! won't be found on mirrors either
+                const bool canFallback = r.code != curl::StatusCode::Values::NotFound;
+                verifyDownload(race->id, race->beatmapPath, *session, r, [race, canFallback](MapResult&& result) {
+                    failSource(race, std::move(result), true, canFallback);
+                });
+            });
+
+        factory_.pushRequest(builder);
+    }
+
+    void startMirror(const std::shared_ptr<MapRace>& race, size_t index) {
+        const Mirror& mirror = mirrors_[index];
+        const size_t source = index + 1;
+
+        std::string path = mirror.path;
+        const std::string id = std::to_string(race->id);
+        for (size_t position = path.find("{id}"); position != std::string::npos; position = path.find("{id}", position + id.size())) {
+            path.replace(position, 4, id);
         }
 
-        authBuilder_
-            .setPath("/home")
+        curl::Builder builder = factory_.createRequest(mirror.host);
+        builder
+            .setPath(path)
             .setUserAgent(HANARU_USER_AGENT)
-            .setRequestType(curl::RequestType::GET);
-        curl::Response mainPageResponse = factory_.syncRequest(authBuilder_);
+            .setLowSpeedLimit(stalledSpeed, stalledTime)
+            .setCancellationToken(race->cancelled)
+            .onData([race, source](curl::Response& r, std::string_view chunk) {
+                return receiveChunk(race, source, r, chunk);
+            })
+            .onError([race, source, host = mirror.host](curl::Response& r) {
+                if (!receiveError(race, source, r)) {
+                    return;
+                }
+
+                if (*race->cancelled) {
+                    failSource(race, cancelledResult(), false, false);
+                    return;
+                }
+
+                LOG_WARN << "Mirror " << host << " failed: " << r.error;
+                failSource(race, { drogon::k503ServiceUnavailable, nullptr, "mirror failed to send archive" }, false, true);
+            })
+            .onComplete([race, source, host = mirror.host](curl::Response& r) {
+                bool lost = false;
+                if (receiveComplete(race, source, lost)) {
+                    publishRaceResult(race);
+                    return;
+                }
+
+                if (lost) {
+                    return;
+                }
+
+                LOG_WARN << "Mirror " << host << " didn't return archive, status code: " << static_cast<uint32_t>(r.code);
+                failSource(race, { drogon::k503ServiceUnavailable, nullptr, "mirror didn't return archive" }, false, true);
+            });
+
+        factory_.pushRequest(builder);
+    }
 
-        if (mainPageResponse.code != curl::StatusCode::Values::OK) {
+    void startRace(const std::shared_ptr<MapRace>& race, std::shared_ptr<hanaru::Authorization>&& session) {
+        // Every client left while session was logging in
+        if (*race->cancelled) {
+            race->callback(cancelledResult());
             return;
         }
 
-        for (const auto& [_, cookie] : mainPageResponse.cookies) {
-            authBuilder_.addCookie(cookie.key, cookie.value);
+        if (session == nullptr) {
+            race->error = MapResult { drogon::k503ServiceUnavailable, nullptr, "no downloader account is available right now, please try again later" };
+        }
+        else if (!downloadBreaker_.allow()) {
+            race->error = MapResult { drogon::k503ServiceUnavailable, nullptr, unavailableMessage() };
+        }
+        else {
+            race->running = 1;
+            startOsu(race, std::move(session), false);
+
+            if (hedgeDelay_ > 0.0 && !mirrors_.empty()) {
+                drogon::app().getLoop()->runAfter(hedgeDelay_, [weakRace = std::weak_ptr<MapRace>(race)]() {
+                    std::shared_ptr<MapRace> race = weakRace.lock();
+                    if (race == nullptr) {
+                        return;
+                    }
 
-            if (cookie.key == "XSRF-TOKEN") {
-                xsrfToken_ = cookie.value;
+                    std::unique_lock<std::mutex> lock { race->mutex };
+                    if (!race->finished && race->nextMirror == 0 && !*race->cancelled) {
+                        launchMirror(race);
+                    }
+                });
             }
+
+            return;
         }
 
-        authBuilder_
-            .setPath("/session")
-            .setReferer("https://osu.ppy.sh/home")
-            .addHeader("Origin", "https://osu.ppy.sh")
-            .addHeader("Alt-Used", "osu.ppy.sh")
-            .addHeader("Content-Type", "application/x-www-form-urlencoded; charset=UTF-8")
-            .addHeader("X-CSRF-Token", xsrfToken_)
-            .setRequestType(curl::RequestType::POST)
-            .setBody(
-                "_token=" + curl::Utils::urlEncode(xsrfToken_) +
-                "&username=" + curl::Utils::urlEncode(username_) +
-                "&password=" + curl::Utils::urlEncode(password_)
-            );
+        // osu! cannot be used right now, so mirrors are the only option
+        std::unique_lock<std::mutex> lock { race->mutex };
+        if (mirrors_.empty()) {
+            race->finished = true;
+            lock.unlock();
+
+            race->callback(std::move(*race->error));
+            return;
+        }
+
+        launchMirror(race);
+    }
+
+    // Same as bufferMap, but archive is never fully buffered in memory, it goes into temporary file and to subscribers of stream.
+    // If osu! fails, mirrors are tried in order, and if osu! doesn't start sending archive in time, first mirror is raced against it.
+    void streamMap(int64_t id, std::function<void(MapResult&&)>&& callback, hanaru::scheduler::SlotPtr&& slot, std::shared_ptr<std::atomic_bool>&& cancelled) {
+        auto race = std::make_shared<MapRace>();
+        race->id = id;
+        race->beatmapPath = hanaru::storage::resolvePath(id);
+        race->callback = std::move(callback);
+        race->slot = std::move(slot);
+        race->cancelled = std::move(cancelled);
+
+        withSession([race](std::shared_ptr<hanaru::Authorization> session) { startRace(race, std::move(session)); }, race->cancelled);
+    }
 
-        curl::Response authResponse = factory_.syncRequest(authBuilder_);
+    // Loads beatmapset from disk or osu!, caller must be leader of its flight
+    void loadMap(int64_t id) {
+        auto complete = [id](MapResult&& result) {
+            forgetInterest(id);
+            retireStream(id);
+            mapsInFlight_.complete(id, std::move(result));
+        };
 
-        if (authResponse.code != curl::StatusCode::Values::OK) {
+        if (!hanaru::verifyRateLimit(20)) {
+            complete({ drogon::k429TooManyRequests, nullptr, "rate limit, please wait 2 seconds" });
             return;
         }
 
-        authBuilder_.resetCookies();
-        authBuilder_.resetHeaders();
+        drogon::orm::DbClientPtr db = drogon::app().getDbClient();
+        std::string idAsString = std::to_string(id);
+        const std::filesystem::path beatmapPath = hanaru::storage::resolvePath(id);
 
-        for (const auto& [_, cookie] : authResponse.cookies) {
-            if (cookie.domain == ".ppy.sh") {
-                if (cookie.key == "XSRF-TOKEN") {
-                    xsrfToken_ = cookie.value;
-                }
+        // Trying to find beatmap on disk
+        if (hanaru::storage::hasFile(id)) {
+            // Only stored beatmapsets are counted, so ids that clients made up don't take memory
+            hanaru::storage::recordAccess(id);
+            std::string contents = hanaru::storage::readFile(beatmapPath);
 
-                if (cookie.key == "osu_session") {
-                    sessionToken_ = cookie.value;
-                }
+            if (contents.empty()) {
+                complete({ drogon::k404NotFound, nullptr, "beatmapset doesn't exist on osu! servers or this beatmapset was banned" });
+                return;
             }
+
+            db->execSqlAsync("SELECT name FROM beatmaps_names WHERE id = ? LIMIT 1;",
+                [id, idAsString_ = std::move(idAsString), contents_ = std::move(contents), complete](const drogon::orm::Result& result) mutable {
+                    std::string filename = idAsString_ + ".osz";
+
+                    if (!result.empty()) {
+                        const auto& row = result.front();
+                        filename = row["name"].as<std::string>();
+                    }
+
+                    complete({ drogon::k200OK, hanaru::storage::insert(id, std::move(filename), std::move(contents_)), "" });
+                },
+                [complete](const drogon::orm::DrogonDbException&) { complete({ drogon::k500InternalServerError, nullptr, "something went wrong, please report me!" }); }, id
+            );
+            return;
         }
 
-        valid_ = true;
-    }
+        if (!hasUsableSession() && mirrors_.empty()) {
+            complete({ drogon::k423Locked, nullptr, "downloading disabled" });
+            return;
+        }
 
-    void deAuth() {
-        if (!valid_ || sessionToken_.empty() || xsrfToken_.empty()) {
+        if (!hanaru::verifyRateLimit(40)) {
+            complete({ drogon::k429TooManyRequests, nullptr, "rate limit, please wait 6 seconds" });
             return;
         }
 
-        authBuilder_
-            .setPath("/session")
-            .setReferer("https://osu.ppy.sh")
-            .addHeader("Origin", "https://osu.ppy.sh")
-            .addHeader("Alt-Used", "osu.ppy.sh")
-            .addHeader("X-CSRF-Token", xsrfToken_)
-            .addCookie("XSRF-TOKEN", xsrfToken_)
-            .addCookie("osu_session", sessionToken_)
-            .setRequestType(curl::RequestType::DELETE);
-        static_cast<void>(factory_.syncRequest(authBuilder_));
+        // Without mirrors only archives from disk can be served while osu! is throttling us, there is no point in waiting for slot
+        if (mirrors_.empty() && downloadBreaker_.retryAfter() != 0) {
+            complete({ drogon::k503ServiceUnavailable, nullptr, unavailableMessage() });
+            return;
+        }
+
+        // Clients might leave while download is waiting for slot or is in progress, then it's aborted to free slot and bandwidth
+        auto cancelled = std::make_shared<std::atomic_bool>(false);
+        watchInterest(id, cancelled);
+
+        hanaru::scheduler::schedule(hanaru::Priority::Interactive,
+            [id, complete, cancelled](hanaru::scheduler::SlotPtr slot) mutable {
+                if (*cancelled) {
+                    complete(cancelledResult());
+                    return;
+                }
 
-        xsrfToken_.clear();
-        sessionToken_.clear();
-        valid_ = false;
+                // Without free space archive cannot be streamed through temporary file
+                if (!hanaru::storage::canWrite()) {
+                    bufferMap(id, std::move(complete), std::move(slot), std::move(cancelled));
+                    return;
+                }
+
+                streamMap(id, std::move(complete), std::move(slot), std::move(cancelled));
+            },
+            [complete]() { complete({ drogon::k503ServiceUnavailable, nullptr, "too many downloads in progress, please try again later" }); }
+        );
     }
 
 }
 
 namespace hanaru {
 
-    void downloader::initialize(const std::string& apiKey, const std::string& username, const std::string& password) {
-        detail::apiKey_ = apiKey;
-        detail::username_ = username;
-        detail::password_ = password;
+    void downloader::initialize(
+        const std::vector<std::string>& apiKeys,
+        const std::vector<Credentials>& accounts,
+        uint64_t sessionBudget,
+        size_t failureThreshold,
+        uint64_t baseBackoff,
+        uint64_t maxBackoff,
+        const std::vector<std::string>& mirrors,
+        double hedgeDelay,
+        size_t apiPipeliningDepth
+    ) {
+        for (const std::string& apiKey : apiKeys) {
+            if (!apiKey.empty()) {
+                detail::apiKeys_.push_back(std::make_shared<ApiKey>(apiKey));
+            }
+        }
+
+        detail::apiPipeliningDepth_ = std::max<size_t>(apiPipeliningDepth, 1);
+        detail::hedgeDelay_ = hedgeDelay;
+
+        for (const std::string& mirror : mirrors) {
+            // Template is split into host and path, because curler builds URL from them
+            const size_t scheme = mirror.find("://");
+            const size_t pathStart = mirror.find('/', scheme == std::string::npos ? 0 : scheme + 3);
+
+            if (scheme == std::string::npos || pathStart == scheme + 3) {
+                LOG_WARN << "Mirror " << mirror << " is not valid URL, skipping it";
+                continue;
+            }
+
+            if (pathStart == std::string::npos) {
+                detail::mirrors_.push_back({ mirror, "/" });
+                continue;
+            }
+
+            detail::mirrors_.push_back({ mirror.substr(0, pathStart), mirror.substr(pathStart) });
+        }
+
+        detail::downloadBreaker_.configure(failureThreshold, baseBackoff, maxBackoff);
+        detail::apiBreaker_.configure(failureThreshold, baseBackoff, maxBackoff);
+        detail::osuFileBreaker_.configure(failureThreshold, baseBackoff, maxBackoff);
+
+        for (const Credentials& credentials : accounts) {
+            if (credentials.username.empty() || credentials.password.empty()) {
+                continue;
+            }
+
+            // Downloads that come before session is ready are waiting for it
+            auto session = std::make_shared<Authorization>(detail::factory_, credentials, sessionBudget);
+            session->reAuth();
 
-        detail::auth();
+            detail::sessions_.push_back(std::move(session));
+        }
+
+        if (!detail::sessions_.empty()) {
+            drogon::app().getLoop()->runEvery(detail::sessionRestoreInterval, &detail::restoreSessions);
+        }
     }
     
-    void downloader::downloadBeatmap(int64_t id, std::function<void(std::tuple<Json::Value, drogon::HttpStatusCode>&&)>&& callback) {
-        if (detail::apiKey_.empty()) {
+    void downloader::downloadBeatmap(int64_t id, std::function<void(std::tuple<Json::Value, drogon::HttpStatusCode>&&)>&& callback, Priority priority) {
+        if (detail::apiKeys_.empty()) {
             callback({ Json::objectValue, drogon::k404NotFound });
             return;
         }
 
-        drogon::HttpRequestPtr request = drogon::HttpRequest::newHttpRequest();
-        drogon::HttpClientPtr client = drogon::HttpClient::newHttpClient("https://osu.ppy.sh");
+        // Concurrent lookups of the same id are answered by single request to osu! and single write into database
+        if (!detail::beatmapsInFlight_.join(id, std::move(callback))) {
+            return;
+        }
 
-        request->setPath("/api/get_beatmaps");
-        request->setParameter("k", detail::apiKey_);
-        request->setParameter("b", std::to_string(id));
+        auto complete = [id](detail::ApiResult&& result) { detail::beatmapsInFlight_.complete(id, std::move(result)); };
 
-        client->sendRequest(request, [callback = std::move(callback)](drogon::ReqResult result, const drogon::HttpResponsePtr& response) {
-            if (result != drogon::ReqResult::Ok) {
-                callback({ Json::objectValue, drogon::k404NotFound });
+        detail::getBeatmaps({ { "b", std::to_string(id) } }, priority, [complete, priority](drogon::HttpStatusCode code, std::vector<ApiBeatmap>&& beatmaps) {
+            if (code != drogon::k200OK) {
+                complete({ Json::objectValue, code });
                 return;
             }
 
-            const std::shared_ptr<Json::Value>& jsonResponse = response->getJsonObject();
-            if (jsonResponse == nullptr) {
-                callback({ Json::objectValue, drogon::k404NotFound });
+            if (beatmaps.empty()) {
+                complete({ Json::objectValue, drogon::k404NotFound });
                 return;
             }
 
-            Json::Value map = serializeBeatmap((*jsonResponse)[0]);
-            if (map["beatmap_id"].isNumeric()) {
-                callback({ map, drogon::k200OK });
+            auto beatmap = std::make_shared<ApiBeatmap>(std::move(beatmaps.front()));
+
+            // Leader must complete flight no matter what, otherwise every lookup of this id would wait forever.
+            // Flight is completed outside of try, so exception from waiters cannot complete it twice
+            Json::Value response {};
+            try {
+                response = serializeBeatmap(*beatmap);
+            }
+            catch (const std::exception& e) {
+                LOG_WARN << "Failed to serialize beatmap " << beatmap->beatmapId << ": " << e.what();
+                complete({ Json::objectValue, drogon::k500InternalServerError });
                 return;
             }
 
-            callback({ Json::objectValue, drogon::k404NotFound });
+            complete({ std::move(response), drogon::k200OK });
+
+            // Clients almost always ask for other difficulties of the same beatmapset next,
+            // so whole beatmapset is stored right away and their lookups won't reach osu!
+            // Difficulty itself is written together with its beatmapset, and alone only if beatmapset cannot be looked up
+            downloadBeatmapset(beatmap->beatmapsetId, [beatmap](std::tuple<Json::Value, drogon::HttpStatusCode>&& result) {
+                const auto& [beatmapset, code] = result;
+
+                if (code != drogon::k200OK || beatmapset.empty()) {
+                    detail::saveBeatmaps({ *beatmap }, [](bool) {});
+                }
+            }, priority);
         });
     }
 
-    void downloader::downloadBeatmapset(int64_t id, std::function<void(std::tuple<Json::Value, drogon::HttpStatusCode>&&)>&& callback) {
-        if (detail::apiKey_.empty()) {
+    void downloader::downloadBeatmapset(int64_t id, std::function<void(std::tuple<Json::Value, drogon::HttpStatusCode>&&)>&& callback, Priority priority) {
+        if (detail::apiKeys_.empty()) {
             callback({ Json::objectValue, drogon::k404NotFound });
             return;
         }
 
-        drogon::HttpRequestPtr request = drogon::HttpRequest::newHttpRequest();
-        drogon::HttpClientPtr client = drogon::HttpClient::newHttpClient("https://osu.ppy.sh");
+        // Concurrent lookups of the same id are answered by single request to osu! and single write into database
+        if (!detail::beatmapsetsInFlight_.join(id, std::move(callback))) {
+            return;
+        }
+
+        auto complete = [id](detail::ApiResult&& result) { detail::beatmapsetsInFlight_.complete(id, std::move(result)); };
+
+        detail::getBeatmaps({ { "s", std::to_string(id) } }, priority, [id, complete](drogon::HttpStatusCode code, std::vector<ApiBeatmap>&& beatmaps) {
+            if (code != drogon::k200OK) {
+                complete({ Json::objectValue, code });
+                return;
+            }
 
-        request->setPath("/api/get_beatmaps");
-        request->setParameter("k", detail::apiKey_);
-        request->setParameter("s", std::to_string(id));
+            // Leader must complete flight no matter what, otherwise every lookup of this id would wait forever.
+            // Flight is completed outside of try, so exception from waiters cannot complete it twice
+            Json::Value response = Json::arrayValue;
+            try {
+                detail::saveBeatmaps(beatmaps, [](bool) {});
 
-        client->sendRequest(request, [callback = std::move(callback)](drogon::ReqResult result, const drogon::HttpResponsePtr& response) {
-            if (result != drogon::ReqResult::Ok) {
-                callback({ Json::objectValue, drogon::k404NotFound });
+                for (const ApiBeatmap& beatmap : beatmaps) {
+                    response.append(serializeBeatmap(beatmap));
+                }
+            }
+            catch (const std::exception& e) {
+                LOG_WARN << "Failed to store beatmapset " << id << ": " << e.what();
+                complete({ Json::objectValue, drogon::k500InternalServerError });
                 return;
             }
 
-            const std::shared_ptr<Json::Value>& jsonResponse = response->getJsonObject();
-            if (jsonResponse == nullptr) {
-                callback({ Json::objectValue, drogon::k404NotFound });
+            complete({ std::move(response), drogon::k200OK });
+        });
+    }
+
+    void downloader::syncBeatmaps(const std::string& since, size_t limit, std::function<void(std::tuple<std::vector<ApiBeatmap>, drogon::HttpStatusCode>&&)>&& callback, Priority priority) {
+        if (detail::apiKeys_.empty()) {
+            callback({ std::vector<ApiBeatmap> {}, drogon::k404NotFound });
+            return;
+        }
+
+        detail::getBeatmaps({ { "since", since }, { "limit", std::to_string(limit) } }, priority, [callback](drogon::HttpStatusCode code, std::vector<ApiBeatmap>&& beatmaps) {
+            if (code != drogon::k200OK) {
+                callback({ std::vector<ApiBeatmap> {}, code });
                 return;
             }
 
-            Json::Value beatmaps = Json::arrayValue;
-            for (const Json::Value& row : *jsonResponse) {
-                Json::Value map = serializeBeatmap(row);
+            auto rows = std::make_shared<std::vector<ApiBeatmap>>(std::move(beatmaps));
 
-                if (map["beatmap_id"].isNumeric()) {
-                    beatmaps.append(map);
+            detail::saveBeatmaps(*rows, [callback, rows](bool saved) {
+                if (!saved) {
+                    callback({ std::vector<ApiBeatmap> {}, drogon::k500InternalServerError });
+                    return;
                 }
-            }
 
-            callback({ beatmaps, drogon::k200OK });
+                callback({ std::move(*rows), drogon::k200OK });
+            });
         });
     }
 
-    void downloader::downloadMap(int64_t id, std::function<void(std::tuple<drogon::HttpStatusCode, std::string, std::string>&&)>&& callback) {
+    void downloader::downloadMap(
+        int64_t id,
+        std::function<void(std::tuple<drogon::HttpStatusCode, std::shared_ptr<const Beatmap>, std::string>&&)>&& callback,
+        std::function<void(std::shared_ptr<MapStream>)>&& onStream,
+        Cancellation cancellation
+    ) {
         if (!verifyRateLimit(1)) {
-            callback({ drogon::k429TooManyRequests, "", "rate limit, please try again" });
+            callback({ drogon::k429TooManyRequests, nullptr, "rate limit, please try again" });
+            return;
+        }
+
+        if (auto sBeatmap = storage::find(id)) {
+            storage::recordAccess(id);
+            callback({ drogon::k200OK, std::move(sBeatmap), "" });
             return;
         }
 
-        if (const auto sBeatmap = storage::find(id)) {
-            callback({ drogon::k200OK, sBeatmap->name(), sBeatmap->content() });
+        std::function<void(detail::MapResult&&)> waiterCallback = std::move(callback);
+
+        if (onStream) {
+            auto waiter = std::make_shared<detail::MapWaiter>();
+            waiter->callback = std::move(waiterCallback);
+            waiter->onStream = std::move(onStream);
+
+            std::unique_lock<std::mutex> lock { detail::streamsMutex_ };
+
+            // Archive is being downloaded right now, so already received part is sent immediately
+            const auto it = detail::streams_.find(id);
+            if (it != detail::streams_.end()) {
+                std::shared_ptr<MapStream> stream = it->second;
+                lock.unlock();
+
+                detail::registerInterest(id, cancellation);
+                waiter->onStream(std::move(stream));
+                return;
+            }
+
+            detail::streamWaiters_[id].push_back(waiter);
+            waiterCallback = [waiter](detail::MapResult&& result) {
+                if (!waiter->streaming) {
+                    waiter->callback(std::move(result));
+                }
+            };
+        }
+
+        // Only first miss loads beatmapset and pays for it, others are attached to it and receive the same archive
+        detail::registerInterest(id, cancellation);
+        if (detail::mapsInFlight_.join(id, std::move(waiterCallback)) || detail::takeOverPrefetch(id)) {
+            detail::loadMap(id);
+        }
+    }
+
+    void downloader::fetchMap(int64_t id, std::function<void(std::tuple<drogon::HttpStatusCode, std::shared_ptr<const Beatmap>, std::string>&&)>&& callback, Priority priority) {
+        if (!detail::hasUsableSession()) {
+            callback({ drogon::k423Locked, nullptr, "downloading disabled" });
             return;
         }
 
-        if (!verifyRateLimit(20)) {
-            callback({ drogon::k429TooManyRequests, "", "rate limit, please wait 2 seconds" });
+        if (detail::downloadBreaker_.retryAfter() != 0) {
+            callback({ drogon::k503ServiceUnavailable, nullptr, detail::unavailableMessage() });
             return;
         }
 
-        drogon::orm::DbClientPtr db = drogon::app().getDbClient();
-        std::string idAsString = std::to_string(id);
-        const std::filesystem::path beatmapPath = hanaru::storage::getBeatmapsPath() / idAsString;
+        scheduler::schedule(priority,
+            [id, callback](scheduler::SlotPtr slot) mutable { detail::bufferMap(id, std::move(callback), std::move(slot), nullptr); },
+            [callback]() { callback({ drogon::k503ServiceUnavailable, nullptr, "too many downloads in progress, please try again later" }); }
+        );
+    }
 
-        // Trying to find beatmap on disk
-        if (std::filesystem::exists(beatmapPath)) {
-            std::ifstream beatmapFile { beatmapPath, std::ios::binary };
+    void downloader::prefetchMap(int64_t id, std::function<void(std::tuple<drogon::HttpStatusCode, std::shared_ptr<const Beatmap>, std::string>&&)>&& callback, uint64_t maxSpeed) {
+        // Background jobs that request beatmapset while it's being prefetched are attached to prefetch, clients take it over instead.
+        // Prefetch without speed limit is as fast as client's own download, so it's never aborted and clients are attached to it as well
+        if (!detail::mapsInFlight_.join(id, std::move(callback))) {
+            return;
+        }
 
-            std::string contents {};
-            beatmapFile.seekg(0, std::ios::end);
-            contents.resize(beatmapFile.tellg());
-            beatmapFile.seekg(0, std::ios::beg);
-            beatmapFile.read(contents.data(), contents.size());
-            beatmapFile.close();
+        auto flight = std::make_shared<detail::PrefetchFlight>();
 
-            if (contents.empty()) {
-                callback({ drogon::k404NotFound, "", "beatmapset doesn't exist on osu! servers or this beatmapset was banned" });
+        if (maxSpeed != 0) {
+            std::unique_lock<std::mutex> lock { detail::prefetchesMutex_ };
+            detail::prefetches_[id] = flight;
+        }
+
+        auto complete = [id, flight](detail::MapResult&& result) {
+            // Client took prefetch over, so flight is completed by its download
+            if (flight->claimed.exchange(true)) {
                 return;
             }
 
-            db->execSqlAsync("SELECT name FROM beatmaps_names WHERE id = ? LIMIT 1;",
-                [id, idAsString_ = std::move(idAsString), contents_ = std::move(contents), callback](const drogon::orm::Result& result) mutable {
-                    std::string filename = idAsString_ + ".osz";
+            {
+                std::unique_lock<std::mutex> lock { detail::prefetchesMutex_ };
 
-                    if (!result.empty()) {
-                        const auto& row = result.front();
-                        filename = row["name"].as<std::string>();
-                    }
+                const auto it = detail::prefetches_.find(id);
+                if (it != detail::prefetches_.end() && it->second == flight) {
+                    detail::prefetches_.erase(it);
+                }
+            }
 
-                    const auto sBeatmap = storage::insert(id, std::move(filename), std::move(contents_));
-                    callback({ drogon::k200OK, sBeatmap->name(), sBeatmap->content() });
-                },
-                [callback](const drogon::orm::DrogonDbException&) { callback({}); }, id
-            );
+            detail::forgetInterest(id);
+            detail::retireStream(id);
+            detail::mapsInFlight_.complete(id, std::move(result));
+        };
+
+        if (!detail::hasUsableSession()) {
+            complete({ drogon::k423Locked, nullptr, "downloading disabled" });
             return;
         }
 
-        if (!detail::valid_) {
-            callback({ drogon::k423Locked, "", "downloading disabled" });
+        if (detail::downloadBreaker_.retryAfter() != 0) {
+            complete({ drogon::k503ServiceUnavailable, nullptr, detail::unavailableMessage() });
             return;
         }
 
-        if (!verifyRateLimit(40)) {
-            callback({ drogon::k429TooManyRequests, "", "rate limit, please wait 6 seconds" });
+        scheduler::schedule(Priority::Bulk,
+            [id, complete, maxSpeed, cancelled = flight->cancelled](scheduler::SlotPtr slot) mutable {
+                detail::bufferMap(id, std::move(complete), std::move(slot), std::move(cancelled), maxSpeed);
+            },
+            [complete]() { complete({ drogon::k503ServiceUnavailable, nullptr, "too many downloads in progress, please try again later" }); }
+        );
+    }
+
+    void downloader::downloadOsuFile(int64_t id, std::function<void(std::tuple<drogon::HttpStatusCode, std::string, std::string>&&)>&& callback) {
+        if (detail::osuFileBreaker_.retryAfter() != 0) {
+            callback({ drogon::k503ServiceUnavailable, "", detail::unavailableMessage(detail::osuFileBreaker_) });
             return;
         }
 
-        const std::string beatmapsetId = std::to_string(id);
-        curl::Builder builder = detail::factory_.createRequest("https://osu.ppy.sh");
-        builder
-            .setPath("/beatmapsets/" + beatmapsetId + "/download")
-            .setParameter("noVideo", "1")
-            .addHeader("Alt-Used", "osu.ppy.sh")
-            .addHeader("Connection", "keep-alive")
-            .addHeader("X-CSRF-Token", detail::xsrfToken_)
-            .addCookie("XSRF-TOKEN", detail::xsrfToken_)
-            .addCookie("osu_session", detail::sessionToken_)
-            .setUserAgent(HANARU_USER_AGENT)
-            .setReferer("https://osu.ppy.sh/beatmapsets/" + beatmapsetId)
-            .onError([callback](curl::Response& r) {
-                callback({ drogon::k500InternalServerError, "", r.error });
-            })
-            .onComplete([id, beatmapPath, callback](curl::Response& r) {
-                switch (r.code) {
-                    case curl::StatusCode::Values::Forbidden:
-                    case curl::StatusCode::Values::Unauthorized: {
-                        callback({ drogon::k401Unauthorized, "", "our downloader become unauthorized, please try again later" });
-
-                        std::unique_lock<std::mutex> lock { detail::reAuthMutex_, std::try_to_lock };
+        scheduler::schedule(Priority::Interactive,
+            [id, callback](scheduler::SlotPtr slot) {
+                if (!detail::osuFileBreaker_.allow()) {
+                    callback({ drogon::k503ServiceUnavailable, "", detail::unavailableMessage(detail::osuFileBreaker_) });
+                    return;
+                }
 
-                        if (lock.owns_lock()) {
-                            detail::deAuth();
-                            detail::auth();
-                        }
+                drogon::HttpRequestPtr request = drogon::HttpRequest::newHttpRequest();
+                request->setPath("/osu/" + std::to_string(id));
 
+                // File doesn't need session, so it goes through the same persistent connection as osu! API
+                detail::apiClient()->sendRequest(request, [callback, slot = std::move(slot)](drogon::ReqResult result, const drogon::HttpResponsePtr& response) {
+                    if (result != drogon::ReqResult::Ok) {
+                        detail::osuFileBreaker_.recordFailure();
+                        callback({ drogon::k503ServiceUnavailable, "", "osu! didn't respond, please try again later" });
                         return;
                     }
-                    case curl::StatusCode::Values::NotFound: {
-                        std::ofstream beatmapFile;
-                        beatmapFile.open(beatmapPath);
-                        beatmapFile.close();
 
-                        callback({ drogon::k404NotFound, "", "beatmapset doesn't exist on osu! servers or this beatmapset was banned" });
+                    if (response->statusCode() == drogon::k429TooManyRequests) {
+                        detail::osuFileBreaker_.recordThrottled();
+                        callback({ drogon::k503ServiceUnavailable, "", detail::unavailableMessage(detail::osuFileBreaker_) });
                         return;
                     }
-                    case curl::StatusCode::Values::TooManyRequests: {
-                        callback({ drogon::k429TooManyRequests, "", "downloader was limited by osu! system, please wait 15 minutes before retrying" });
+
+                    if (response->statusCode() >= drogon::k500InternalServerError) {
+                        detail::osuFileBreaker_.recordFailure();
+                        callback({ drogon::k503ServiceUnavailable, "", "response from osu! wasn't valid" });
                         return;
                     }
-                    case curl::StatusCode::Values::OK: {
-                        if (r.body.empty() || r.body.find("PK\x03\x04") != 0) {
-                            LOG_WARN << "Response was not valid osz file: " << (r.body.size() > 100 ? r.body.substr(0, 100) : r.body);
-                            callback({ drogon::k422UnprocessableEntity, "", "response from osu! wasn't valid osz file" });
-                            return;
-                        }
 
-                        const auto range = r.cookies.equal_range("xsrf-token");
-                        for (auto it = range.first; it != range.second; it++) {
-                            if (it->second.value.size() == detail::xsrfToken_.size() && it->second.domain == ".ppy.sh") {
-                                detail::xsrfToken_ = it->second.value;
-                                break;
-                            }
-                        }
-
-                        const auto sBeatmap = storage::insert(id, getFilenameFromLink(r.headers), std::move(r.body));
-
-                        if (storage::canWrite()) {
-                            saveBeatmapToDB(id, sBeatmap->name());
-                            if (r.saveToFile(beatmapPath.generic_string())) {
-                                storage::decreaseAvailableSpace(sBeatmap->size());
-                            }
-                        }
+                    detail::osuFileBreaker_.recordSuccess();
 
-                        callback({ drogon::k200OK, sBeatmap->name(), sBeatmap->content() });
+                    // osu! sends empty file for beatmaps it doesn't have
+                    if (response->statusCode() != drogon::k200OK || response->body().empty()) {
+                        callback({ drogon::k404NotFound, "", "beatmap doesn't exist on osu! servers" });
                         return;
                     }
-                    default: {
-                        callback({ drogon::k503ServiceUnavailable, "", "response from osu! wasn't valid" });
-                        return;
-                    }
-                }
-            });
 
-        detail::factory_.pushRequest(builder);
+                    callback({ drogon::k200OK, std::string { response->body() }, "" });
+                }, static_cast<double>(deadlines::lookup()));
+            },
+            [callback]() { callback({ drogon::k503ServiceUnavailable, "", "too many downloads in progress, please try again later" }); }
+        );
     }
 }
 
-Json::Value hanaru::downloader::serializeBeatmap(const Json::Value& json) {
-    if (json.isNull()) {
-        return {};
+Json::Value hanaru::downloader::serializeBeatmap(const ApiBeatmap& beatmap) {
+    Json::Value json;
+
+    json["beatmap_id"]       = beatmap.beatmapId;
+    json["beatmapset_id"]    = beatmap.beatmapsetId;
+    json["beatmap_md5"]      = beatmap.md5;
+    json["artist"]           = beatmap.artist;
+    json["title"]            = beatmap.title;
+    json["version"]          = beatmap.version;
+    json["creator"]          = beatmap.creator;
+    json["count_normal"]     = beatmap.countNormal;
+    json["count_slider"]     = beatmap.countSlider;
+    json["count_spinner"]    = beatmap.countSpinner;
+    json["max_combo"]        = beatmap.maxCombo;
+    json["ranked_status"]    = beatmap.rankedStatus;
+    json["latest_update"]    = beatmap.lastUpdate;
+    json["bpm"]              = static_cast<int32_t>(beatmap.bpm);
+    json["hit_length"]       = beatmap.hitLength;
+
+    json["difficulty"] = beatmap.difficulty;
+
+    json["cs"] = beatmap.cs;
+    json["ar"] = beatmap.ar;
+    json["od"] = beatmap.od;
+    json["hp"] = beatmap.hp;
+    json["mode"] = beatmap.mode;
+
+    return json;
+}
+
+std::string hanaru::downloader::getFilenameFromLink(int64_t id, const std::unordered_multimap<std::string, std::string>& headers) {
+    const auto it = headers.find("location");
+    if (it == headers.end()) {
+        return getFilenameFromDisposition(id, headers);
     }
 
-    std::string approved = "0";
-    std::string maxCombo = "0";
-    drogon::orm::DbClientPtr db = drogon::app().getDbClient();
+    const std::string& link = it->second;
 
-    if (json["max_combo"].isString()) {
-        maxCombo = json["max_combo"].asString();
-    }
+    std::string filename = link.substr(link.find("fs=") + 3);
+    filename = filename.substr(0, filename.find(".osz") + 4);
 
-    if (json["approved_date"].isString()) {
-        approved = json["approved"].asString();
-    }
+    return drogon::utils::urlDecode(filename);
+}
 
-    const int32_t mode = std::stoi(json["mode"].asString());
+bool hanaru::downloader::hasApiKeys() {
+    return !detail::apiKeys_.empty();
+}
 
-    std::string std = "0";
-    std::string taiko = "0";
-    std::string ctb = "0";
-    std::string mania = "0";
+Json::Value hanaru::downloader::circuitBreakers() {
+    Json::Value breakers = Json::objectValue;
+    breakers["download"] = detail::downloadBreaker_.toJson();
+    breakers["api"] = detail::apiBreaker_.toJson();
+    breakers["osu_file"] = detail::osuFileBreaker_.toJson();
 
-    switch (mode) {
-        case 0:
-        default: {
-            std = json["difficultyrating"].asString();
-            break;
-        }
-        case 1: {
-            taiko = json["difficultyrating"].asString();
-            break;
-        }
-        case 2: {
-            ctb = json["difficultyrating"].asString();
-            break;
-        }
-        case 3: {
-            mania = json["difficultyrating"].asString();
-            break;
-        }
+    return breakers;
+}
+
+Json::Value hanaru::downloader::apiKeys() {
+    std::unique_lock<std::mutex> lock { detail::apiKeysMutex_ };
+    Json::Value keys = Json::arrayValue;
+
+    for (const auto& key : detail::apiKeys_) {
+        keys.append(key->toJson());
     }
 
-    // This is way safer to firstly apply beatmap to database, so we won't lose it if exception happends when casting strings
-    db->execSqlAsync(
-        "INSERT IGNORE INTO beatmaps (beatmap_id, beatmapset_id, beatmap_md5, mode, "
-        "artist, title, difficulty_name, creator, "
-        "count_normal, count_slider, count_spinner, max_combo, "
-        "ranked_status, creating_date, bpm, hit_length, "
-        "cs, ar, od, hp, "
-        "difficulty_std, difficulty_taiko, difficulty_ctb, difficulty_mania) "
-        "VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?, ?);",
-        [](const drogon::orm::Result&) {},
-        [](const drogon::orm::DrogonDbException&) {},
-        json["beatmap_id"].asString(), json["beatmapset_id"].asString(), json["file_md5"].asString(), json["mode"].asString(),
-        json["artist"].asString(), json["title"].asString(), json["version"].asString(), json["creator"].asString(),
-        json["count_normal"].asString(), json["count_slider"].asString(), json["count_spinner"].asString(), maxCombo,
-        approved, hanaru::stringToTime(json["last_update"]), json["bpm"].asString(), json["hit_length"].asString(),
-        json["diff_size"].asString(), json["diff_approach"].asString(), json["diff_overall"].asString(), json["diff_drain"].asString(),
-        std, taiko, ctb, mania
-    );
+    return keys;
+}
+
+Json::Value hanaru::downloader::sessions() {
+    std::unique_lock<std::mutex> lock { detail::sessionsMutex_ };
+    Json::Value sessions = Json::arrayValue;
 
-    try {
-        Json::Value beatmap;
-
-        beatmap["beatmap_id"]       = std::stoi(json["beatmap_id"].asString());
-        beatmap["beatmapset_id"]    = std::stoi(json["beatmapset_id"].asString());
-        beatmap["beatmap_md5"]      = json["file_md5"].asString();
-        beatmap["artist"]           = json["artist"].asString();
-        beatmap["title"]            = json["title"].asString();
-        beatmap["version"]          = json["version"].asString();
-        beatmap["creator"]          = json["creator"].asString();
-        beatmap["count_normal"]     = std::stoi(json["count_normal"].asString());
-        beatmap["count_slider"]     = std::stoi(json["count_slider"].asString());
-        beatmap["count_spinner"]    = std::stoi(json["count_spinner"].asString());
-        beatmap["max_combo"]        = std::stoi(maxCombo);
-        beatmap["ranked_status"]    = std::stoi(json["approved"].asString());
-        beatmap["latest_update"]    = json["last_update"].asString();
-        beatmap["bpm"]              = std::stoi(json["bpm"].asString());
-        beatmap["hit_length"]       = std::stoi(json["hit_length"].asString());
-
-        beatmap["difficulty"] = std::stof(json["difficultyrating"].asString());
-
-        beatmap["cs"] = std::stof(json["diff_size"].asString());
-        beatmap["ar"] = std::stof(json["diff_approach"].asString());
-        beatmap["od"] = std::stof(json["diff_overall"].asString());
-        beatmap["hp"] = std::stof(json["diff_drain"].asString());
-        beatmap["mode"] = mode;
-
-        return beatmap;
-    }
-    catch (const std::exception& ex) {
-        LOG_WARN << ex.what();
-        return {};
+    for (const auto& session : detail::sessions_) {
+        sessions.append(session->toJson());
     }
+
+    return sessions;
 }
 
-std::string hanaru::downloader::getFilenameFromLink(const std::unordered_multimap<std::string, std::string>& headers) {
-    const std::string link = headers.equal_range("location").first->second;
+std::string hanaru::downloader::getFilenameFromDisposition(int64_t id, const std::unordered_multimap<std::string, std::string>& headers) {
+    const auto it = headers.find("content-disposition");
+    if (it == headers.end()) {
+        return std::to_string(id) + ".osz";
+    }
 
-    std::string filename = link.substr(link.find("fs=") + 3);
-    filename = filename.substr(0, filename.find(".osz") + 4);
+    const std::string& disposition = it->second;
+    const size_t start = disposition.find("filename=");
+    if (start == std::string::npos) {
+        return std::to_string(id) + ".osz";
+    }
 
-    return drogon::utils::urlDecode(filename);
+    std::string filename = disposition.substr(start + 9);
+    filename = filename.substr(0, filename.find(';'));
+
+    if (filename.size() >= 2 && filename.front() == '"' && filename.back() == '"') {
+        filename = filename.substr(1, filename.size() - 2);
+    }
+
+    // Name is used in our own Content-Disposition, so it mustn't contain anything that breaks header
+    if (filename.empty() || filename.find_first_of("\"/\r\n") != std::string::npos) {
+        return std::to_string(id) + ".osz";
+    }
+
+    return filename;
 }
 
 void hanaru::downloader::saveBeatmapToDB(int64_t id, const std::string& filename) {
     drogon::orm::DbClientPtr db = drogon::app().getDbClient();
 
-    db->execSqlAsync("INSERT INTO beatmaps_names (id, name) VALUES (?, ?);",
+    // Archive is tagged with fetch time and last known status, so revalidator can tell if osu! has newer version
+    db->execSqlAsync(
+        "INSERT INTO beatmaps_names (id, name, latest_update, ranked_status) "
+        "SELECT ?, ?, ?, COALESCE(MAX(ranked_status), ?) FROM beatmaps WHERE beatmapset_id = ? "
+        "ON DUPLICATE KEY UPDATE name = VALUES(name), latest_update = VALUES(latest_update), ranked_status = VALUES(ranked_status);",
         [](const drogon::orm::Result&) {},
         [](const drogon::orm::DrogonDbException&) {},
-        id, filename
+        id, filename, hanaru::timeFromEpoch(), static_cast<int32_t>(hanaru::RankedStatus::Unknown), id
     );
 }
\ No newline at end of file
@@ -3,22 +3,76 @@
 #include <drogon/HttpAppFramework.h>
 #include <drogon/HttpClient.h>
 
+#include "authorization.hh"
+#include "cancellation.hh"
+#include "map_stream.hh"
+#include "osu_api.hh"
+#include "scheduler.hh"
 #include "storage_manager.hh"
 
 namespace hanaru {
 
     namespace downloader {
 
-        void initialize(const std::string& apiKey, const std::string& username, const std::string& password);
+        // Lookups are spread between API keys by their remaining budget, every key is limited the same way as osu! limits it.
+        // Every account gets own web session with `sessionBudget` downloads per hour (0 means unlimited).
+        // Both osu! endpoints get own circuit breaker, backoff is in seconds.
+        // Mirrors are URL templates where `{id}` is replaced by id of beatmapset, they are tried in order when osu! fails.
+        // If hedge delay (in seconds) is not 0 and osu! didn't start sending archive in time, first mirror is raced against it.
+        // Requests to osu! API are pipelined up to given depth over persistent connection of every event loop.
+        void initialize(
+            const std::vector<std::string>& apiKeys,
+            const std::vector<Credentials>& accounts,
+            uint64_t sessionBudget,
+            size_t failureThreshold,
+            uint64_t baseBackoff,
+            uint64_t maxBackoff,
+            const std::vector<std::string>& mirrors,
+            double hedgeDelay,
+            size_t apiPipeliningDepth
+        );
 
-        void downloadBeatmap(int64_t id, std::function<void(std::tuple<Json::Value, drogon::HttpStatusCode>&&)>&& callback);
-        void downloadBeatmapset(int64_t id, std::function<void(std::tuple<Json::Value, drogon::HttpStatusCode>&&)>&& callback);
-        void downloadMap(int64_t id, std::function<void(std::tuple<drogon::HttpStatusCode, std::string, std::string>&&)>&& callback);
+        // Other difficulties of the same beatmapset are fetched and stored as well
+        void downloadBeatmap(int64_t id, std::function<void(std::tuple<Json::Value, drogon::HttpStatusCode>&&)>&& callback, Priority priority = Priority::Interactive);
+        void downloadBeatmapset(int64_t id, std::function<void(std::tuple<Json::Value, drogon::HttpStatusCode>&&)>&& callback, Priority priority = Priority::Interactive);
+        // Upserts up to `limit` beatmaps approved after `since` (date in osu! format, e.g. "2007-01-01 00:00:00") and returns them once they are saved.
+        // Status of beatmaps with `ranked_status_freezed` is left untouched (same goes for lookups above).
+        void syncBeatmaps(const std::string& since, size_t limit, std::function<void(std::tuple<std::vector<ApiBeatmap>, drogon::HttpStatusCode>&&)>&& callback, Priority priority = Priority::Bulk);
+        // On success beatmap is not null, otherwise string contains reason of failure.
+        // If onStream is provided and beatmapset is being downloaded from osu!, then archive is sent through stream instead of callback.
+        // Download from osu! is aborted once every client that waits for this beatmapset is cancelled.
+        void downloadMap(
+            int64_t id,
+            std::function<void(std::tuple<drogon::HttpStatusCode, std::shared_ptr<const Beatmap>, std::string>&&)>&& callback,
+            std::function<void(std::shared_ptr<MapStream>)>&& onStream = nullptr,
+            Cancellation cancellation = {}
+        );
+        // Downloads beatmapset from osu! without looking into cache or disk, stored archive is replaced on success
+        void fetchMap(int64_t id, std::function<void(std::tuple<drogon::HttpStatusCode, std::shared_ptr<const Beatmap>, std::string>&&)>&& callback, Priority priority = Priority::Interactive);
+        // Downloads beatmapset from osu! with bulk priority and given speed limit (in bytes per second, 0 means no limit),
+        // background jobs that request it in the meantime wait for this download, while clients abort speed limited one and start own download instead
+        void prefetchMap(int64_t id, std::function<void(std::tuple<drogon::HttpStatusCode, std::shared_ptr<const Beatmap>, std::string>&&)>&& callback, uint64_t maxSpeed);
+        // Downloads single .osu file from osu!, on success string contains file, otherwise reason of failure
+        void downloadOsuFile(int64_t id, std::function<void(std::tuple<drogon::HttpStatusCode, std::string, std::string>&&)>&& callback);
 
-        Json::Value serializeBeatmap(const Json::Value& json);
-        std::string getFilenameFromLink(const std::unordered_multimap<std::string, std::string>& headers);
+        // Beatmap in format of `/b/` and `/s/` responses
+        Json::Value serializeBeatmap(const ApiBeatmap& beatmap);
+        // Falls back to Content-Disposition and then to `{id}.osz` if osu! didn't redirect to storage
+        std::string getFilenameFromLink(int64_t id, const std::unordered_multimap<std::string, std::string>& headers);
+        // Used for mirrors, falls back to `{id}.osz`
+        std::string getFilenameFromDisposition(int64_t id, const std::unordered_multimap<std::string, std::string>& headers);
         void saveBeatmapToDB(int64_t id, const std::string& filename);
 
+        // Returns false if osu! API cannot be used, because no key was configured
+        bool hasApiKeys();
+
+        // State of circuit breakers of osu! endpoints
+        Json::Value circuitBreakers();
+        // State and remaining budget of every osu! account
+        Json::Value sessions();
+        // State and remaining budget of every osu! API key
+        Json::Value apiKeys();
+
     }
 
 }
@@ -0,0 +1,221 @@
+#include "image.hh"
+
+#include <algorithm>
+#include <csetjmp>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include <jpeglib.h>
+#include <png.h>
+
+namespace detail {
+
+    // Dimensions are taken from headers of untrusted images, bigger ones are rejected before memory is allocated for them
+    constexpr uint64_t maxPixels = 8192 * 8192;
+
+    bool fitsLimit(uint32_t width, uint32_t height) {
+        return width > 0 && height > 0 && static_cast<uint64_t>(width) * height <= maxPixels;
+    }
+
+    class RgbImage {
+    public:
+        uint32_t width = 0;
+        uint32_t height = 0;
+        std::vector<uint8_t> pixels {};
+    };
+
+    // libjpeg calls exit() on errors by default, so we have to jump out of it instead
+    class JpegErrorManager {
+    public:
+        jpeg_error_mgr base {};
+        std::jmp_buf jump {};
+    };
+
+    void jpegErrorExit(j_common_ptr info) {
+        std::longjmp(reinterpret_cast<JpegErrorManager*>(info->err)->jump, 1);
+    }
+
+    void jpegOutputMessage(j_common_ptr) {}
+
+    // Objects with non-trivial destructors must not be created in this function because of longjmp
+    bool decodeJpeg(std::string_view data, uint32_t targetWidth, RgbImage& image) {
+        jpeg_decompress_struct info {};
+        JpegErrorManager error {};
+
+        info.err = jpeg_std_error(&error.base);
+        error.base.error_exit = &jpegErrorExit;
+        error.base.output_message = &jpegOutputMessage;
+
+        if (setjmp(error.jump)) {
+            jpeg_destroy_decompress(&info);
+            return false;
+        }
+
+        jpeg_create_decompress(&info);
+        jpeg_mem_src(&info, reinterpret_cast<unsigned char*>(const_cast<char*>(data.data())), static_cast<unsigned long>(data.size()));
+        jpeg_read_header(&info, TRUE);
+
+        // libjpeg can downscale while decoding by 1/2, 1/4 and 1/8, which is way cheaper than doing it after
+        info.out_color_space = JCS_RGB;
+        info.scale_num = 1;
+        info.scale_denom = 1;
+        while (info.scale_denom < 8 && info.image_width / (info.scale_denom * 2) >= targetWidth) {
+            info.scale_denom *= 2;
+        }
+
+        jpeg_calc_output_dimensions(&info);
+        if (!fitsLimit(info.output_width, info.output_height)) {
+            jpeg_destroy_decompress(&info);
+            return false;
+        }
+
+        jpeg_start_decompress(&info);
+
+        image.width = info.output_width;
+        image.height = info.output_height;
+        image.pixels.resize(static_cast<size_t>(image.width) * image.height * 3);
+
+        while (info.output_scanline < info.output_height) {
+            JSAMPROW row = image.pixels.data() + static_cast<size_t>(info.output_scanline) * image.width * 3;
+            jpeg_read_scanlines(&info, &row, 1);
+        }
+
+        jpeg_finish_decompress(&info);
+        jpeg_destroy_decompress(&info);
+
+        return true;
+    }
+
+    bool decodePng(std::string_view data, RgbImage& image) {
+        png_image info {};
+        info.version = PNG_IMAGE_VERSION;
+
+        if (!png_image_begin_read_from_memory(&info, data.data(), data.size())) {
+            return false;
+        }
+
+        if (!fitsLimit(info.width, info.height)) {
+            png_image_free(&info);
+            return false;
+        }
+
+        info.format = PNG_FORMAT_RGB;
+        image.width = info.width;
+        image.height = info.height;
+        image.pixels.resize(PNG_IMAGE_SIZE(info));
+
+        if (!png_image_finish_read(&info, nullptr, image.pixels.data(), 0, nullptr)) {
+            png_image_free(&info);
+            return false;
+        }
+
+        return true;
+    }
+
+    // Box filter, each destination pixel is average of all source pixels it covers
+    RgbImage downscale(const RgbImage& source, uint32_t width) {
+        if (source.width <= width) {
+            return source;
+        }
+
+        RgbImage result {};
+        result.width = width;
+        result.height = std::max<uint32_t>(1, static_cast<uint32_t>(static_cast<uint64_t>(source.height) * width / source.width));
+        result.pixels.resize(static_cast<size_t>(result.width) * result.height * 3);
+
+        for (uint32_t y = 0; y < result.height; y++) {
+            const uint32_t sourceTop = static_cast<uint32_t>(static_cast<uint64_t>(y) * source.height / result.height);
+            const uint32_t sourceBottom = std::max(sourceTop + 1, static_cast<uint32_t>(static_cast<uint64_t>(y + 1) * source.height / result.height));
+
+            for (uint32_t x = 0; x < result.width; x++) {
+                const uint32_t sourceLeft = static_cast<uint32_t>(static_cast<uint64_t>(x) * source.width / result.width);
+                const uint32_t sourceRight = std::max(sourceLeft + 1, static_cast<uint32_t>(static_cast<uint64_t>(x + 1) * source.width / result.width));
+
+                uint64_t sum[3] = { 0, 0, 0 };
+                for (uint32_t sy = sourceTop; sy < sourceBottom; sy++) {
+                    const uint8_t* pixel = source.pixels.data() + (static_cast<size_t>(sy) * source.width + sourceLeft) * 3;
+
+                    for (uint32_t sx = sourceLeft; sx < sourceRight; sx++, pixel += 3) {
+                        sum[0] += pixel[0];
+                        sum[1] += pixel[1];
+                        sum[2] += pixel[2];
+                    }
+                }
+
+                const uint64_t count = static_cast<uint64_t>(sourceBottom - sourceTop) * (sourceRight - sourceLeft);
+                uint8_t* destination = result.pixels.data() + (static_cast<size_t>(y) * result.width + x) * 3;
+                destination[0] = static_cast<uint8_t>(sum[0] / count);
+                destination[1] = static_cast<uint8_t>(sum[1] / count);
+                destination[2] = static_cast<uint8_t>(sum[2] / count);
+            }
+        }
+
+        return result;
+    }
+
+    bool encodeJpeg(const RgbImage& image, int quality, unsigned char*& buffer, unsigned long& size) {
+        jpeg_compress_struct info {};
+        JpegErrorManager error {};
+
+        info.err = jpeg_std_error(&error.base);
+        error.base.error_exit = &jpegErrorExit;
+        error.base.output_message = &jpegOutputMessage;
+
+        if (setjmp(error.jump)) {
+            jpeg_destroy_compress(&info);
+            return false;
+        }
+
+        jpeg_create_compress(&info);
+        jpeg_mem_dest(&info, &buffer, &size);
+
+        info.image_width = image.width;
+        info.image_height = image.height;
+        info.input_components = 3;
+        info.in_color_space = JCS_RGB;
+
+        jpeg_set_defaults(&info);
+        jpeg_set_quality(&info, quality, TRUE);
+        jpeg_start_compress(&info, TRUE);
+
+        while (info.next_scanline < info.image_height) {
+            JSAMPROW row = const_cast<uint8_t*>(image.pixels.data()) + static_cast<size_t>(info.next_scanline) * image.width * 3;
+            jpeg_write_scanlines(&info, &row, 1);
+        }
+
+        jpeg_finish_compress(&info);
+        jpeg_destroy_compress(&info);
+
+        return true;
+    }
+
+}
+
+namespace hanaru {
+
+    std::optional<std::string> image::makeThumbnail(std::string_view data, uint32_t width, int quality) {
+        detail::RgbImage decoded {};
+
+        const bool isJpeg = data.size() > 2 && data.substr(0, 2) == "\xFF\xD8";
+        const bool isPng = data.size() > 8 && data.substr(0, 8) == "\x89PNG\r\n\x1A\n";
+
+        if (!(isJpeg && detail::decodeJpeg(data, width, decoded)) && !(isPng && detail::decodePng(data, decoded))) {
+            return std::nullopt;
+        }
+
+        unsigned char* buffer = nullptr;
+        unsigned long size = 0;
+
+        if (!detail::encodeJpeg(detail::downscale(decoded, width), quality, buffer, size)) {
+            std::free(buffer);
+            return std::nullopt;
+        }
+
+        std::string result { reinterpret_cast<const char*>(buffer), size };
+        std::free(buffer);
+
+        return result;
+    }
+
+}
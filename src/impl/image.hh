@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace hanaru {
+
+    namespace image {
+
+        // Decodes JPEG or PNG image, downscales it to `width` (images smaller than that are not upscaled)
+        // and encodes it back as JPEG with provided quality.
+        // Returns std::nullopt if image cannot be decoded or it's too big to be decoded safely.
+        std::optional<std::string> makeThumbnail(std::string_view data, uint32_t width, int quality);
+
+    }
+
+}
@@ -0,0 +1,185 @@
+#include "map_stream.hh"
+
+#include <algorithm>
+
+namespace detail {
+
+    // Size of pieces in which archive is read from temporary file, so it's never loaded whole into memory
+    constexpr size_t readChunkSize = 64 * 1024;
+    // Subscriber isn't given more until client received what was sent to it, so every client holds at most that much in memory
+    constexpr size_t maxBacklog = 1024 * 1024;
+    // In seconds, how often subscriber with full backlog checks if client received something
+    constexpr double backlogCheckInterval = 0.05;
+
+}
+
+namespace hanaru {
+
+    MapStream::MapStream(std::string&& name, const std::filesystem::path& path)
+        : name_ { std::move(name) }
+        , path_ { path }
+        , temporaryPath_ { path }
+    {
+        temporaryPath_ += ".part";
+        file_.open(temporaryPath_, std::ios::binary | std::ios::trunc);
+    }
+
+    const std::string& MapStream::name() const {
+        return name_;
+    }
+
+    void MapStream::subscribe(trantor::EventLoop* loop, ChunkHandler&& onChunk, BacklogHandler&& backlog, FinishHandler&& onFinish) {
+        auto subscriber = std::make_shared<Subscriber>();
+        subscriber->loop = loop;
+        subscriber->onChunk = std::move(onChunk);
+        subscriber->backlog = std::move(backlog);
+        subscriber->onFinish = std::move(onFinish);
+
+        {
+            std::unique_lock<std::mutex> lock { mutex_ };
+
+            // Writer is blocked only until file is opened, already downloaded part is read by subscriber itself
+            if (!finished_) {
+                file_.flush();
+            }
+
+            subscriber->file.open(finished_ ? path_ : temporaryPath_, std::ios::binary);
+            subscribers_.push_back(subscriber);
+        }
+
+        loop->queueInLoop([self = shared_from_this(), subscriber]() { self->pump(subscriber); });
+    }
+
+    bool MapStream::write(std::string_view chunk) {
+        std::vector<std::shared_ptr<Subscriber>> idle {};
+
+        {
+            std::unique_lock<std::mutex> lock { mutex_ };
+
+            file_.write(chunk.data(), chunk.size());
+
+            // Subscribers read from file, so chunk must be visible there before they are told about it
+            if (!subscribers_.empty()) {
+                file_.flush();
+            }
+
+            // Chunk that didn't reach the file must not be announced, owner aborts download and fails subscribers instead
+            if (!file_.good()) {
+                return false;
+            }
+
+            written_ += chunk.size();
+
+            for (const auto& subscriber : subscribers_) {
+                if (subscriber->idle) {
+                    subscriber->idle = false;
+                    idle.push_back(subscriber);
+                }
+            }
+        }
+
+        wake(std::move(idle));
+        return true;
+    }
+
+    bool MapStream::finish(bool success) {
+        std::vector<std::shared_ptr<Subscriber>> idle {};
+        bool saved = false;
+
+        {
+            std::unique_lock<std::mutex> lock { mutex_ };
+
+            file_.close();
+            success_ = success && !file_.fail();
+
+            std::error_code ec {};
+            if (success_) {
+                std::filesystem::rename(temporaryPath_, path_, ec);
+                success_ = !ec;
+            }
+
+            if (!success_) {
+                std::filesystem::remove(temporaryPath_, ec);
+            }
+
+            finished_ = true;
+            saved = success_;
+
+            for (const auto& subscriber : subscribers_) {
+                if (subscriber->idle) {
+                    subscriber->idle = false;
+                    idle.push_back(subscriber);
+                }
+            }
+        }
+
+        wake(std::move(idle));
+        return saved;
+    }
+
+    void MapStream::pump(const std::shared_ptr<Subscriber>& subscriber) {
+        std::string buffer(detail::readChunkSize, '\0');
+
+        while (true) {
+            size_t available = 0;
+
+            {
+                std::unique_lock<std::mutex> lock { mutex_ };
+
+                // Part of archive that failed is useless for client
+                if (finished_ && !success_) {
+                    lock.unlock();
+                    detach(subscriber, false);
+                    return;
+                }
+
+                available = written_;
+
+                if (subscriber->sent >= available) {
+                    if (!finished_) {
+                        subscriber->idle = true;
+                        return;
+                    }
+
+                    lock.unlock();
+                    detach(subscriber, true);
+                    return;
+                }
+            }
+
+            if (subscriber->backlog() >= detail::maxBacklog) {
+                subscriber->loop->runAfter(detail::backlogCheckInterval, [self = shared_from_this(), subscriber]() { self->pump(subscriber); });
+                return;
+            }
+
+            subscriber->file.clear();
+            subscriber->file.read(buffer.data(), std::min(available - subscriber->sent, buffer.size()));
+            const size_t read = static_cast<size_t>(subscriber->file.gcount());
+
+            if (read == 0 || !subscriber->onChunk(std::string_view { buffer.data(), read })) {
+                detach(subscriber, false);
+                return;
+            }
+
+            subscriber->sent += read;
+        }
+    }
+
+    void MapStream::wake(std::vector<std::shared_ptr<Subscriber>>&& subscribers) {
+        for (auto& subscriber : subscribers) {
+            trantor::EventLoop* loop = subscriber->loop;
+            loop->queueInLoop([self = shared_from_this(), subscriber = std::move(subscriber)]() { self->pump(subscriber); });
+        }
+    }
+
+    void MapStream::detach(const std::shared_ptr<Subscriber>& subscriber, bool success) {
+        {
+            std::unique_lock<std::mutex> lock { mutex_ };
+            subscribers_.erase(std::remove(subscribers_.begin(), subscribers_.end(), subscriber), subscribers_.end());
+        }
+
+        subscriber->file.close();
+        subscriber->onFinish(success);
+    }
+
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <trantor/net/EventLoop.h>
+
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace hanaru {
+
+    // Archive that is being downloaded from osu! right now.
+    // Every chunk is written into temporary file, subscribers read it from there at their own pace,
+    // so slow clients never stall download and never hold more than small part of archive in memory.
+    class MapStream : public std::enable_shared_from_this<MapStream> {
+    public:
+        // Returns false if subscriber isn't interested in further chunks (e.g. client disconnected)
+        using ChunkHandler = std::function<bool(std::string_view)>;
+        // Returns amount of bytes that were handed to subscriber, but aren't received by client yet
+        using BacklogHandler = std::function<size_t()>;
+        // Receives true if whole archive was sent to subscriber
+        using FinishHandler = std::function<void(bool)>;
+
+        MapStream(std::string&& name, const std::filesystem::path& path);
+
+        MapStream(const MapStream&) = delete;
+        MapStream& operator=(const MapStream&) = delete;
+
+        const std::string& name() const;
+
+        // Handlers are called only inside of given event loop
+        void subscribe(trantor::EventLoop* loop, ChunkHandler&& onChunk, BacklogHandler&& backlog, FinishHandler&& onFinish);
+
+        // Must be called only by downloader, returns false if chunk cannot be written on disk
+        bool write(std::string_view chunk);
+        // Temporary file is moved into place before subscribers are notified, returns true if archive was saved
+        bool finish(bool success);
+
+    private:
+        class Subscriber {
+        public:
+            trantor::EventLoop* loop = nullptr;
+            ChunkHandler onChunk {};
+            BacklogHandler backlog {};
+            FinishHandler onFinish {};
+
+            // Opened before archive is moved into place, so it stays readable after rename
+            std::ifstream file {};
+            size_t sent = 0;
+            // Set while subscriber has sent everything that was written and waits for next chunk
+            bool idle = false;
+        };
+
+        // Sends to subscriber what it can receive right now, runs inside of subscriber's event loop
+        void pump(const std::shared_ptr<Subscriber>& subscriber);
+        void wake(std::vector<std::shared_ptr<Subscriber>>&& subscribers);
+        void detach(const std::shared_ptr<Subscriber>& subscriber, bool success);
+
+        std::mutex mutex_ {};
+        std::string name_ {};
+        std::filesystem::path path_ {};
+        std::filesystem::path temporaryPath_ {};
+        std::ofstream file_ {};
+
+        size_t written_ = 0;
+        bool finished_ = false;
+        bool success_ = false;
+
+        std::vector<std::shared_ptr<Subscriber>> subscribers_ {};
+    };
+
+}
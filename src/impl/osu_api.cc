@@ -0,0 +1,331 @@
+#include "osu_api.hh"
+
+#include <charconv>
+
+namespace detail {
+
+    // Value of single field, strings are left as they are in body until field decides what it needs from them
+    class ApiToken {
+    public:
+        std::string_view raw {};
+        bool escaped = false;
+        bool null = false;
+    };
+
+    bool isWhitespace(char c) {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+    }
+
+    class ApiReader {
+    public:
+        explicit ApiReader(std::string_view body)
+            : body_ { body }
+        {}
+
+        // Skips whitespace and consumes `c` if it goes next
+        bool consume(char c) {
+            skipWhitespace();
+
+            if (position_ < body_.size() && body_[position_] == c) {
+                position_++;
+                return true;
+            }
+
+            return false;
+        }
+
+        bool readString(ApiToken& token) {
+            if (!consume('"')) {
+                return false;
+            }
+
+            const size_t begin = position_;
+            token.escaped = false;
+            token.null = false;
+
+            while (position_ < body_.size()) {
+                const char c = body_[position_];
+
+                if (c == '"') {
+                    token.raw = body_.substr(begin, position_ - begin);
+                    position_++;
+                    return true;
+                }
+
+                if (c == '\\') {
+                    token.escaped = true;
+                    position_++;
+                }
+
+                position_++;
+            }
+
+            return false;
+        }
+
+        // osu! sends every field as string or null, other literals are read as they are and nested values are skipped
+        bool readValue(ApiToken& token) {
+            skipWhitespace();
+
+            if (position_ >= body_.size()) {
+                return false;
+            }
+
+            const char c = body_[position_];
+
+            if (c == '"') {
+                return readString(token);
+            }
+
+            if (c == '{' || c == '[') {
+                token = { {}, false, true };
+                return skipNested();
+            }
+
+            const size_t begin = position_;
+            while (position_ < body_.size() && body_[position_] != ',' && body_[position_] != '}' && body_[position_] != ']' && !isWhitespace(body_[position_])) {
+                position_++;
+            }
+
+            token.raw = body_.substr(begin, position_ - begin);
+            token.escaped = false;
+            token.null = token.raw == "null";
+            return !token.raw.empty();
+        }
+
+    private:
+        void skipWhitespace() {
+            while (position_ < body_.size() && isWhitespace(body_[position_])) {
+                position_++;
+            }
+        }
+
+        bool skipNested() {
+            ApiToken ignored {};
+            size_t depth = 0;
+
+            while (position_ < body_.size()) {
+                const char c = body_[position_];
+
+                if (c == '"') {
+                    if (!readString(ignored)) {
+                        return false;
+                    }
+
+                    continue;
+                }
+
+                position_++;
+
+                if (c == '{' || c == '[') {
+                    depth++;
+                }
+                else if ((c == '}' || c == ']') && --depth == 0) {
+                    return true;
+                }
+            }
+
+            return false;
+        }
+
+        std::string_view body_;
+        size_t position_ = 0;
+    };
+
+    bool readHex(std::string_view str, size_t position, uint32_t& value) {
+        if (position + 4 > str.size()) {
+            return false;
+        }
+
+        const char* end = str.data() + position + 4;
+        const auto [ptr, ec] = std::from_chars(str.data() + position, end, value, 16);
+        return ec == std::errc {} && ptr == end;
+    }
+
+    void appendUtf8(std::string& out, uint32_t codepoint) {
+        if (codepoint < 0x80) {
+            out.push_back(static_cast<char>(codepoint));
+        }
+        else if (codepoint < 0x800) {
+            out.push_back(static_cast<char>(0xC0 | (codepoint >> 6)));
+            out.push_back(static_cast<char>(0x80 | (codepoint & 0x3F)));
+        }
+        else if (codepoint < 0x10000) {
+            out.push_back(static_cast<char>(0xE0 | (codepoint >> 12)));
+            out.push_back(static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | (codepoint & 0x3F)));
+        }
+        else {
+            out.push_back(static_cast<char>(0xF0 | (codepoint >> 18)));
+            out.push_back(static_cast<char>(0x80 | ((codepoint >> 12) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | ((codepoint >> 6) & 0x3F)));
+            out.push_back(static_cast<char>(0x80 | (codepoint & 0x3F)));
+        }
+    }
+
+    // osu! escapes every non-ASCII character, so names in other languages always end up here
+    bool unescape(std::string_view raw, std::string& out) {
+        out.clear();
+        out.reserve(raw.size());
+
+        for (size_t i = 0; i < raw.size(); i++) {
+            if (raw[i] != '\\') {
+                out.push_back(raw[i]);
+                continue;
+            }
+
+            if (++i >= raw.size()) {
+                return false;
+            }
+
+            switch (raw[i]) {
+                case '"':
+                case '\\':
+                case '/': out.push_back(raw[i]); break;
+                case 'b': out.push_back('\b'); break;
+                case 'f': out.push_back('\f'); break;
+                case 'n': out.push_back('\n'); break;
+                case 'r': out.push_back('\r'); break;
+                case 't': out.push_back('\t'); break;
+                case 'u': {
+                    uint32_t codepoint = 0;
+                    if (!readHex(raw, i + 1, codepoint) || (codepoint >= 0xDC00 && codepoint <= 0xDFFF)) {
+                        return false;
+                    }
+
+                    i += 4;
+
+                    // Characters outside of basic plane are sent as surrogate pair
+                    if (codepoint >= 0xD800 && codepoint <= 0xDBFF) {
+                        uint32_t low = 0;
+
+                        if (i + 2 >= raw.size() || raw[i + 1] != '\\' || raw[i + 2] != 'u' || !readHex(raw, i + 3, low) || low < 0xDC00 || low > 0xDFFF) {
+                            return false;
+                        }
+
+                        codepoint = 0x10000 + ((codepoint - 0xD800) << 10) + (low - 0xDC00);
+                        i += 6;
+                    }
+
+                    appendUtf8(out, codepoint);
+                    break;
+                }
+                default: return false;
+            }
+        }
+
+        return true;
+    }
+
+    // Null keeps default value
+    template <typename T>
+    bool toNumber(const ApiToken& token, T& value) {
+        if (token.null) {
+            return true;
+        }
+
+        if (token.escaped) {
+            return false;
+        }
+
+        const char* end = token.raw.data() + token.raw.size();
+        const auto [ptr, ec] = std::from_chars(token.raw.data(), end, value);
+        return ec == std::errc {} && ptr == end;
+    }
+
+    bool toText(const ApiToken& token, std::string& value) {
+        if (token.null) {
+            value.clear();
+            return true;
+        }
+
+        if (!token.escaped) {
+            value.assign(token.raw);
+            return true;
+        }
+
+        return unescape(token.raw, value);
+    }
+
+    // Returns false if value of known field is malformed, fields that aren't stored are ignored
+    bool assignField(hanaru::ApiBeatmap& beatmap, std::string_view key, const ApiToken& value) {
+        if (key == "beatmap_id")        return toNumber(value, beatmap.beatmapId);
+        if (key == "beatmapset_id")     return toNumber(value, beatmap.beatmapsetId);
+        if (key == "file_md5")          return toText(value, beatmap.md5);
+        if (key == "mode")              return toNumber(value, beatmap.mode);
+        if (key == "artist")            return toText(value, beatmap.artist);
+        if (key == "title")             return toText(value, beatmap.title);
+        if (key == "version")           return toText(value, beatmap.version);
+        if (key == "creator")           return toText(value, beatmap.creator);
+        if (key == "count_normal")      return toNumber(value, beatmap.countNormal);
+        if (key == "count_slider")      return toNumber(value, beatmap.countSlider);
+        if (key == "count_spinner")     return toNumber(value, beatmap.countSpinner);
+        if (key == "max_combo")         return toNumber(value, beatmap.maxCombo);
+        if (key == "approved")          return toNumber(value, beatmap.rankedStatus);
+        if (key == "approved_date")     return toText(value, beatmap.approvedDate);
+        if (key == "last_update")       return toText(value, beatmap.lastUpdate);
+        if (key == "bpm")               return toNumber(value, beatmap.bpm);
+        if (key == "hit_length")        return toNumber(value, beatmap.hitLength);
+        if (key == "difficultyrating")  return toNumber(value, beatmap.difficulty);
+        if (key == "diff_size")         return toNumber(value, beatmap.cs);
+        if (key == "diff_approach")     return toNumber(value, beatmap.ar);
+        if (key == "diff_overall")      return toNumber(value, beatmap.od);
+        if (key == "diff_drain")        return toNumber(value, beatmap.hp);
+
+        return true;
+    }
+
+}
+
+namespace hanaru {
+
+    std::optional<std::vector<ApiBeatmap>> osu_api::parseBeatmaps(std::string_view body) {
+        detail::ApiReader reader { body };
+        std::vector<ApiBeatmap> beatmaps {};
+
+        if (!reader.consume('[')) {
+            return std::nullopt;
+        }
+
+        if (reader.consume(']')) {
+            return beatmaps;
+        }
+
+        do {
+            ApiBeatmap beatmap {};
+            bool valid = true;
+
+            if (!reader.consume('{')) {
+                return std::nullopt;
+            }
+
+            if (!reader.consume('}')) {
+                do {
+                    detail::ApiToken key {};
+                    detail::ApiToken value {};
+
+                    if (!reader.readString(key) || !reader.consume(':') || !reader.readValue(value)) {
+                        return std::nullopt;
+                    }
+
+                    valid = detail::assignField(beatmap, key.raw, value) && valid;
+                } while (reader.consume(','));
+
+                if (!reader.consume('}')) {
+                    return std::nullopt;
+                }
+            }
+
+            if (valid && beatmap.beatmapId > 0 && beatmap.beatmapsetId > 0) {
+                beatmaps.push_back(std::move(beatmap));
+            }
+        } while (reader.consume(','));
+
+        if (!reader.consume(']')) {
+            return std::nullopt;
+        }
+
+        return beatmaps;
+    }
+
+}
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace hanaru {
+
+    // Single difficulty from `/api/get_beatmaps`, numbers are already decoded from strings osu! sends them as
+    class ApiBeatmap {
+    public:
+        int64_t beatmapId = 0;
+        int64_t beatmapsetId = 0;
+        std::string md5 {};
+        int32_t mode = 0;
+
+        std::string artist {};
+        std::string title {};
+        std::string version {};
+        std::string creator {};
+
+        uint32_t countNormal = 0;
+        uint32_t countSlider = 0;
+        uint32_t countSpinner = 0;
+        // osu! doesn't know it for some old beatmaps, 0 then
+        uint32_t maxCombo = 0;
+
+        int32_t rankedStatus = 0;
+        // Both dates are in osu! format (e.g. "2007-01-01 00:00:00"), approval date is empty if beatmap was never approved
+        std::string approvedDate {};
+        std::string lastUpdate {};
+
+        double bpm = 0.0;
+        // In seconds
+        int64_t hitLength = 0;
+
+        float difficulty = 0.0f;
+        float cs = 0.0f;
+        float ar = 0.0f;
+        float od = 0.0f;
+        float hp = 0.0f;
+    };
+
+    namespace osu_api {
+
+        // Decodes response body straight into beatmaps, without building JSON tree and without exceptions.
+        // Difficulties without id or with malformed numbers are skipped, empty optional means that body is not a list of beatmaps (e.g. error of osu! API).
+        std::optional<std::vector<ApiBeatmap>> parseBeatmaps(std::string_view body);
+
+    }
+
+}
@@ -0,0 +1,310 @@
+#include "osu_file.hh"
+
+#include <drogon/utils/Utilities.h>
+
+#include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <vector>
+
+namespace detail {
+
+    std::string_view trimView(std::string_view str) {
+        const size_t begin = str.find_first_not_of(" \t\r\n");
+        if (begin == std::string_view::npos) {
+            return {};
+        }
+
+        const size_t end = str.find_last_not_of(" \t\r\n");
+        return str.substr(begin, end - begin + 1);
+    }
+
+    std::vector<std::string_view> splitView(std::string_view str, char delimiter) {
+        std::vector<std::string_view> values {};
+        size_t last = 0;
+        size_t next = 0;
+
+        while ((next = str.find(delimiter, last)) != std::string_view::npos) {
+            values.push_back(trimView(str.substr(last, next - last)));
+            last = next + 1;
+        }
+
+        values.push_back(trimView(str.substr(last)));
+        return values;
+    }
+
+    // Calls handler for every non-empty line which is not a comment or section header, with name of section it belongs to.
+    // Iteration stops when handler returns false.
+    template <typename F>
+    void forEachLine(std::string_view content, F&& handler) {
+        std::string_view section {};
+        size_t position = 0;
+
+        while (position < content.size()) {
+            size_t lineEnd = content.find('\n', position);
+            if (lineEnd == std::string_view::npos) {
+                lineEnd = content.size();
+            }
+
+            const std::string_view line = trimView(content.substr(position, lineEnd - position));
+            position = lineEnd + 1;
+
+            if (line.empty() || line.substr(0, 2) == "//") {
+                continue;
+            }
+
+            if (line.front() == '[' && line.back() == ']') {
+                section = line.substr(1, line.size() - 2);
+                continue;
+            }
+
+            if (!handler(section, line)) {
+                return;
+            }
+        }
+    }
+
+    // Returns fallback if value is not a number, trailing garbage (e.g. `1:0:0:0:` after end time of hold note) is ignored
+    template <typename T>
+    T toNumber(std::string_view str, T fallback = 0) {
+        T value = fallback;
+
+        if (std::from_chars(str.data(), str.data() + str.size(), value).ec != std::errc {}) {
+            return fallback;
+        }
+
+        return value;
+    }
+
+    std::string unquote(std::string_view str) {
+        if (str.size() >= 2 && str.front() == '"' && str.back() == '"') {
+            str = str.substr(1, str.size() - 2);
+        }
+
+        return std::string { str };
+    }
+
+}
+
+namespace hanaru {
+
+    bool osu_file::isOsuFile(const std::string& name) {
+        if (name.size() < 4) {
+            return false;
+        }
+
+        std::string extension = name.substr(name.size() - 4);
+        std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return std::tolower(c); });
+        return extension == ".osu";
+    }
+
+    std::string osu_file::findBackground(std::string_view content) {
+        std::string background {};
+
+        detail::forEachLine(content, [&background](std::string_view section, std::string_view line) {
+            if (section != "Events") {
+                return true;
+            }
+
+            // Background event is `0,0,"filename",x,y`, older beatmaps might use `Background` instead of 0
+            const std::vector<std::string_view> values = detail::splitView(line, ',');
+            if (values.size() >= 3 && (values[0] == "0" || values[0] == "Background")) {
+                background = detail::unquote(values[2]);
+                return false;
+            }
+
+            return true;
+        });
+
+        return background;
+    }
+
+    std::string osu_file::findAudio(std::string_view content) {
+        std::string audio {};
+
+        detail::forEachLine(content, [&audio](std::string_view section, std::string_view line) {
+            const size_t delimiter = line.find(':');
+            if (section != "General" || delimiter == std::string_view::npos) {
+                return true;
+            }
+
+            if (detail::trimView(line.substr(0, delimiter)) == "AudioFilename") {
+                audio = detail::trimView(line.substr(delimiter + 1));
+                return false;
+            }
+
+            return true;
+        });
+
+        return audio;
+    }
+
+    std::optional<OsuMetadata> osu_file::parseMetadata(std::string_view content) {
+        class TimingPoint {
+        public:
+            double time = 0.0;
+            double beatLength = 0.0;
+        };
+
+        class Break {
+        public:
+            double start = 0.0;
+            double end = 0.0;
+        };
+
+        OsuMetadata metadata {};
+        std::vector<TimingPoint> timingPoints {};
+        std::vector<Break> breaks {};
+        std::optional<double> firstObject {};
+        double lastObject = 0.0;
+        bool hasApproachRate = false;
+
+        detail::forEachLine(content, [&](std::string_view section, std::string_view line) {
+            if (section == "TimingPoints") {
+                const std::vector<std::string_view> values = detail::splitView(line, ',');
+
+                // Inherited points have negative beat length, older beatmaps don't have `uninherited` field at all
+                const double beatLength = values.size() >= 2 ? detail::toNumber<double>(values[1]) : 0.0;
+                if (beatLength > 0.0 && (values.size() < 7 || values[6] != "0")) {
+                    timingPoints.push_back({ detail::toNumber<double>(values[0]), beatLength });
+                }
+
+                return true;
+            }
+
+            if (section == "HitObjects") {
+                const std::vector<std::string_view> values = detail::splitView(line, ',');
+                if (values.size() < 4) {
+                    return true;
+                }
+
+                const double time = detail::toNumber<double>(values[2]);
+                const uint32_t type = detail::toNumber<uint32_t>(values[3]);
+                double end = time;
+
+                // Hold notes of osu!mania are counted as sliders, same as osu! API does
+                if (type & 1) {
+                    metadata.countNormal++;
+                }
+                else if (type & (2 | 128)) {
+                    metadata.countSlider++;
+
+                    if ((type & 128) && values.size() >= 6) {
+                        end = detail::toNumber<double>(values[5], time);
+                    }
+                }
+                else if (type & 8) {
+                    metadata.countSpinner++;
+
+                    if (values.size() >= 6) {
+                        end = detail::toNumber<double>(values[5], time);
+                    }
+                }
+
+                if (!firstObject.has_value()) {
+                    firstObject = time;
+                }
+
+                lastObject = std::max(lastObject, end);
+                return true;
+            }
+
+            if (section == "Events") {
+                const std::vector<std::string_view> values = detail::splitView(line, ',');
+                if (values.size() >= 3 && (values[0] == "2" || values[0] == "Break")) {
+                    breaks.push_back({ detail::toNumber<double>(values[1]), detail::toNumber<double>(values[2]) });
+                }
+
+                return true;
+            }
+
+            const size_t delimiter = line.find(':');
+            if (delimiter == std::string_view::npos) {
+                return true;
+            }
+
+            const std::string_view key = detail::trimView(line.substr(0, delimiter));
+            const std::string_view value = detail::trimView(line.substr(delimiter + 1));
+
+            if (section == "General") {
+                if (key == "Mode") {
+                    metadata.mode = detail::toNumber<int32_t>(value);
+                }
+            }
+            else if (section == "Metadata") {
+                if (key == "Artist") {
+                    metadata.artist = value;
+                }
+                else if (key == "Title") {
+                    metadata.title = value;
+                }
+                else if (key == "Creator") {
+                    metadata.creator = value;
+                }
+                else if (key == "Version") {
+                    metadata.version = value;
+                }
+                else if (key == "BeatmapID") {
+                    metadata.beatmapId = detail::toNumber<int64_t>(value);
+                }
+                else if (key == "BeatmapSetID") {
+                    metadata.beatmapsetId = detail::toNumber<int64_t>(value);
+                }
+            }
+            else if (section == "Difficulty") {
+                if (key == "CircleSize") {
+                    metadata.cs = detail::toNumber<float>(value);
+                }
+                else if (key == "ApproachRate") {
+                    metadata.ar = detail::toNumber<float>(value);
+                    hasApproachRate = true;
+                }
+                else if (key == "OverallDifficulty") {
+                    metadata.od = detail::toNumber<float>(value);
+                }
+                else if (key == "HPDrainRate") {
+                    metadata.hp = detail::toNumber<float>(value);
+                }
+            }
+
+            return true;
+        });
+
+        if (metadata.beatmapId <= 0) {
+            return std::nullopt;
+        }
+
+        // Before approach rate was introduced it was equal to overall difficulty
+        if (!hasApproachRate) {
+            metadata.ar = metadata.od;
+        }
+
+        if (firstObject.has_value()) {
+            double drain = lastObject - firstObject.value();
+
+            for (const Break& pause : breaks) {
+                drain -= std::max(0.0, std::min(pause.end, lastObject) - std::max(pause.start, firstObject.value()));
+            }
+
+            metadata.hitLength = static_cast<int64_t>(std::max(0.0, drain) / 1000.0);
+        }
+
+        double longest = -1.0;
+        for (size_t i = 0; i < timingPoints.size(); i++) {
+            const double start = i == 0 ? std::min(timingPoints[i].time, firstObject.value_or(timingPoints[i].time)) : timingPoints[i].time;
+            const double end = i + 1 < timingPoints.size() ? timingPoints[i + 1].time : std::max(lastObject, timingPoints[i].time);
+
+            if (end - start > longest) {
+                longest = end - start;
+                metadata.bpm = static_cast<int64_t>(60000.0 / timingPoints[i].beatLength + 0.5);
+            }
+        }
+
+        // osu! API returns md5 in lowercase
+        metadata.md5 = drogon::utils::getMd5(content.data(), content.size());
+        std::transform(metadata.md5.begin(), metadata.md5.end(), metadata.md5.begin(), [](unsigned char c) { return std::tolower(c); });
+
+        return metadata;
+    }
+
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+namespace hanaru {
+
+    // Metadata of single difficulty, same as osu! API returns, except for star rating, max combo and ranked status
+    class OsuMetadata {
+    public:
+        int64_t beatmapId = 0;
+        int64_t beatmapsetId = 0;
+        std::string md5 {};
+        int32_t mode = 0;
+
+        std::string artist {};
+        std::string title {};
+        std::string creator {};
+        std::string version {};
+
+        float cs = 0.0f;
+        float ar = 0.0f;
+        float od = 0.0f;
+        float hp = 0.0f;
+
+        // Of the timing point that lasts the longest
+        int64_t bpm = 0;
+        // In seconds, from first to last hit object without breaks
+        int64_t hitLength = 0;
+
+        uint32_t countNormal = 0;
+        uint32_t countSlider = 0;
+        uint32_t countSpinner = 0;
+    };
+
+    namespace osu_file {
+
+        // Checks extension of archive entry, case-insensitive
+        bool isOsuFile(const std::string& name);
+        // Returns filename of background image from [Events] section, empty if beatmap has no background.
+        std::string findBackground(std::string_view content);
+        // Returns filename of audio from [General] section, empty if not specified.
+        std::string findAudio(std::string_view content);
+        // Returns empty optional if file doesn't contain id of beatmap (unsubmitted or too old beatmap), since it cannot be stored without it.
+        std::optional<OsuMetadata> parseMetadata(std::string_view content);
+
+    }
+
+}
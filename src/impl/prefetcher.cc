@@ -0,0 +1,249 @@
+#include "prefetcher.hh"
+
+#include "downloader.hh"
+#include "storage_manager.hh"
+#include "utils.hh"
+
+#include <drogon/HttpAppFramework.h>
+
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace detail {
+
+    // Crawler might find thousands of beatmapsets at once, only the newest ones are worth keeping
+    constexpr size_t maxQueuedBeatmapsets = 1000;
+
+    bool prefetcherEnabled_ = false;
+    uint64_t prefetchBatchSize_ = 0;
+    uint64_t prefetchMaxSpeed_ = 0;
+    uint64_t prefetchMaxAge_ = 0;
+
+    std::mutex queueMutex_ {};
+    // Newest beatmapsets are at the back
+    std::deque<int64_t> queue_ {};
+    std::unordered_set<int64_t> queued_ {};
+
+    // Lookups that are still waiting for download, the oldest ones are counted as not converted if there are more of them
+    constexpr size_t maxPendingLookups = 10000;
+    // Conversion rate isn't trusted until that many lookups were resolved
+    constexpr uint64_t minConversionSamples = 20;
+    // Weight of every resolved lookup in conversion rate, so rate follows recent traffic
+    constexpr double conversionSmoothing = 0.05;
+
+    int64_t speculativeWindow_ = 0;
+    double minConversion_ = 0.0;
+    uint64_t reservedTokens_ = 0;
+
+    std::mutex lookupsMutex_ {};
+    // Beatmapset and time when its lookup stops waiting for download
+    std::unordered_map<int64_t, int64_t> lookups_ {};
+    std::deque<std::pair<int64_t, int64_t>> lookupExpirations_ {};
+    double conversionRate_ = 0.0;
+    uint64_t conversionSamples_ = 0;
+
+    // Lock must be held by caller
+    void recordConversion(bool converted) {
+        conversionSamples_++;
+
+        // Plain average until there are enough samples, so first lookups don't drag rate to zero
+        const double weight = std::max(conversionSmoothing, 1.0 / static_cast<double>(conversionSamples_));
+        conversionRate_ += weight * ((converted ? 1.0 : 0.0) - conversionRate_);
+    }
+
+    // Lock must be held by caller
+    void expireLookups(int64_t now) {
+        while (!lookupExpirations_.empty() && (lookupExpirations_.front().second <= now || lookupExpirations_.size() > maxPendingLookups)) {
+            const auto [id, expiresAt] = lookupExpirations_.front();
+            lookupExpirations_.pop_front();
+
+            // Beatmapset that was looked up again has later expiration
+            const auto it = lookups_.find(id);
+            if (it != lookups_.end() && it->second == expiresAt) {
+                lookups_.erase(it);
+                recordConversion(false);
+            }
+        }
+    }
+
+    void speculate(int64_t id) {
+        // Same price as archive from osu! in /d/ route, speculation only takes tokens that clients don't need right now
+        if (hanaru::remainingRateLimit() < reservedTokens_ + 60 || !hanaru::verifyRateLimit(60)) {
+            return;
+        }
+
+        hanaru::downloader::prefetchMap(id, [id](std::tuple<drogon::HttpStatusCode, std::shared_ptr<const hanaru::Beatmap>, std::string>&& result) {
+            const auto& [code, beatmap, error] = result;
+
+            if (beatmap == nullptr) {
+                LOG_WARN << "Failed to speculatively prefetch beatmapset " << id << ": " << error;
+                return;
+            }
+
+            LOG_INFO << "Beatmapset " << id << " was speculatively prefetched";
+        }, 0);
+    }
+
+    void prefetch() {
+        uint64_t started = 0;
+
+        while (started < prefetchBatchSize_) {
+            int64_t id = 0;
+
+            {
+                std::unique_lock<std::mutex> lock { queueMutex_ };
+
+                if (queue_.empty()) {
+                    return;
+                }
+
+                id = queue_.back();
+                queue_.pop_back();
+                queued_.erase(id);
+            }
+
+            // Doesn't count against batch, nothing was downloaded
+            if (hanaru::storage::hasFile(id)) {
+                continue;
+            }
+
+            // Same price as archive from osu! in /d/ route, if we out of tokens then users should be served first
+            if (!hanaru::verifyRateLimit(60)) {
+                std::unique_lock<std::mutex> lock { queueMutex_ };
+
+                if (queued_.insert(id).second) {
+                    queue_.push_back(id);
+                }
+
+                return;
+            }
+
+            started++;
+            hanaru::downloader::prefetchMap(id, [id](std::tuple<drogon::HttpStatusCode, std::shared_ptr<const hanaru::Beatmap>, std::string>&& result) {
+                const auto& [code, beatmap, error] = result;
+
+                if (beatmap == nullptr) {
+                    LOG_WARN << "Failed to prefetch beatmapset " << id << ": " << error;
+                    return;
+                }
+
+                LOG_INFO << "Beatmapset " << id << " was prefetched";
+            }, prefetchMaxSpeed_);
+        }
+    }
+
+}
+
+namespace hanaru {
+
+    void prefetcher::initialize(uint64_t interval, uint64_t batchSize, uint64_t maxSpeed, uint64_t maxAge) {
+        if (interval == 0 || batchSize == 0) {
+            return;
+        }
+
+        detail::prefetcherEnabled_ = true;
+        detail::prefetchBatchSize_ = batchSize;
+        detail::prefetchMaxSpeed_ = maxSpeed * 1024;
+        detail::prefetchMaxAge_ = maxAge;
+
+        drogon::app().getLoop()->runEvery(static_cast<double>(interval), &detail::prefetch);
+    }
+
+    void prefetcher::notifyApproved(int64_t beatmapsetId, int32_t rankedStatus, int64_t approvedAt) {
+        if (!detail::prefetcherEnabled_) {
+            return;
+        }
+
+        // Loved beatmapsets don't get the same rush of players as ranked ones
+        if (rankedStatus != static_cast<int32_t>(RankedStatus::Ranked)
+            && rankedStatus != static_cast<int32_t>(RankedStatus::Approved)
+            && rankedStatus != static_cast<int32_t>(RankedStatus::Qualified)) {
+            return;
+        }
+
+        if (approvedAt + static_cast<int64_t>(detail::prefetchMaxAge_) < timeFromEpoch()) {
+            return;
+        }
+
+        std::unique_lock<std::mutex> lock { detail::queueMutex_ };
+
+        if (!detail::queued_.insert(beatmapsetId).second) {
+            return;
+        }
+
+        detail::queue_.push_back(beatmapsetId);
+
+        if (detail::queue_.size() > detail::maxQueuedBeatmapsets) {
+            detail::queued_.erase(detail::queue_.front());
+            detail::queue_.pop_front();
+        }
+    }
+
+    void prefetcher::initializeSpeculative(uint64_t window, double minConversion, uint64_t reservedTokens) {
+        detail::speculativeWindow_ = static_cast<int64_t>(window);
+        detail::minConversion_ = minConversion;
+        detail::reservedTokens_ = reservedTokens;
+    }
+
+    void prefetcher::notifyLookup(int64_t beatmapsetId) {
+        if (detail::speculativeWindow_ == 0 || storage::hasFile(beatmapsetId)) {
+            return;
+        }
+
+        const int64_t now = timeFromEpoch();
+        const int64_t expiresAt = now + detail::speculativeWindow_;
+        bool worthIt = false;
+
+        {
+            std::unique_lock<std::mutex> lock { detail::lookupsMutex_ };
+            detail::expireLookups(now);
+
+            // Repeated lookup only extends window, beatmapset is already being prefetched if it was worth it
+            const bool repeated = detail::lookups_.find(beatmapsetId) != detail::lookups_.end();
+
+            detail::lookups_[beatmapsetId] = expiresAt;
+            detail::lookupExpirations_.emplace_back(beatmapsetId, expiresAt);
+
+            worthIt = !repeated && detail::conversionSamples_ >= detail::minConversionSamples && detail::conversionRate_ >= detail::minConversion_;
+        }
+
+        // Download that has to wait for bulk slot would start too late, client would download beatmapset by itself
+        if (!worthIt || !scheduler::hasFreeSlot(Priority::Bulk)) {
+            return;
+        }
+
+        detail::speculate(beatmapsetId);
+    }
+
+    void prefetcher::notifyDownload(int64_t beatmapsetId) {
+        if (detail::speculativeWindow_ == 0) {
+            return;
+        }
+
+        std::unique_lock<std::mutex> lock { detail::lookupsMutex_ };
+        detail::expireLookups(timeFromEpoch());
+
+        const auto it = detail::lookups_.find(beatmapsetId);
+        if (it == detail::lookups_.end()) {
+            return;
+        }
+
+        detail::lookups_.erase(it);
+        detail::recordConversion(true);
+    }
+
+    Json::Value prefetcher::conversion() {
+        std::unique_lock<std::mutex> lock { detail::lookupsMutex_ };
+        Json::Value result = Json::objectValue;
+
+        result["rate"] = detail::conversionRate_;
+        result["samples"] = static_cast<Json::UInt64>(detail::conversionSamples_);
+        result["pending"] = static_cast<Json::UInt64>(detail::lookups_.size());
+
+        return result;
+    }
+
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+
+#include <json/json.h>
+
+namespace hanaru {
+
+    namespace prefetcher {
+
+        // Downloads newly ranked, approved and qualified beatmapsets before players ask for them, so first request is not a cold miss.
+        // Every `interval` seconds up to `batchSize` queued beatmapsets are downloaded with bulk priority, newest first,
+        // each download is limited to `maxSpeed` kilobytes per second (0 means no limit).
+        // Only beatmapsets approved not earlier than `maxAge` seconds ago are queued.
+        // Interval of 0 disables prefetching.
+        void initialize(uint64_t interval, uint64_t batchSize, uint64_t maxSpeed, uint64_t maxAge);
+
+        // Called for every beatmap that was synced from osu!, `approvedAt` is in seconds since epoch
+        void notifyApproved(int64_t beatmapsetId, int32_t rankedStatus, int64_t approvedAt);
+
+        // Downloads beatmapset right after its metadata was looked up, if clients usually download beatmapsets they looked up.
+        // Lookup counts as converted if beatmapset is downloaded in `window` seconds after it, conversion rate must be at least `minConversion` (0 to 1).
+        // Speculative downloads never take tokens of rate limit below `reservedTokens`, so clients are served first.
+        // Window of 0 disables speculative prefetching.
+        void initializeSpeculative(uint64_t window, double minConversion, uint64_t reservedTokens);
+
+        // Called by `/b/` and `/s/` routes for beatmapset that was found
+        void notifyLookup(int64_t beatmapsetId);
+        // Called by `/d/` route
+        void notifyDownload(int64_t beatmapsetId);
+
+        // Observed conversion rate of lookups into downloads
+        Json::Value conversion();
+
+    }
+
+}
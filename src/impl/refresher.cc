@@ -0,0 +1,141 @@
+#include "refresher.hh"
+
+#include "downloader.hh"
+#include "storage_manager.hh"
+#include "utils.hh"
+
+#include <drogon/HttpAppFramework.h>
+
+#include <algorithm>
+#include <cmath>
+
+namespace detail {
+
+    class RefreshCandidate {
+    public:
+        int64_t id = 0;
+        double weight = 0.0;
+    };
+
+    // Beatmapsets that are overdue by more cooldowns than that are equally stale, so popularity decides between them
+    constexpr double maxStaleness = 4.0;
+
+    uint64_t refreshBatchSize_ = 0;
+    uint64_t qualifiedCooldown_ = 0;
+    uint64_t lovedCooldown_ = 0;
+    uint64_t pendingCooldown_ = 0;
+
+    uint64_t cooldownOf(int32_t rankedStatus) {
+        switch (static_cast<hanaru::RankedStatus>(rankedStatus)) {
+            case hanaru::RankedStatus::Qualified: return qualifiedCooldown_;
+            case hanaru::RankedStatus::Loved: return lovedCooldown_;
+            default: return pendingCooldown_;
+        }
+    }
+
+    // Rows that were checked before that are due, disabled statuses are never due
+    int64_t checkedBefore(uint64_t cooldown, int64_t now) {
+        return cooldown == 0 ? 0 : now - static_cast<int64_t>(cooldown);
+    }
+
+    // osu! doesn't know about beatmapset anymore, it's left as is until next cooldown
+    void touchBeatmapset(int64_t id) {
+        drogon::orm::DbClientPtr db = drogon::app().getDbClient();
+
+        db->execSqlAsync(
+            "UPDATE beatmaps SET checked_at = ? WHERE beatmapset_id = ?;",
+            [](const drogon::orm::Result&) {},
+            [](const drogon::orm::DrogonDbException&) {},
+            hanaru::timeFromEpoch(), id
+        );
+    }
+
+    // Whole beatmapset is upserted by single statement inside of downloader, which also moves `checked_at` of its rows
+    void refreshBeatmapset(int64_t id) {
+        hanaru::downloader::downloadBeatmapset(id, [id](std::tuple<Json::Value, drogon::HttpStatusCode>&& result) {
+            const auto& [beatmaps, code] = result;
+
+            // If osu! is unavailable, beatmapset is picked up again on next iteration
+            if (code == drogon::k200OK && beatmaps.empty()) {
+                touchBeatmapset(id);
+            }
+        }, hanaru::Priority::Background);
+    }
+
+    void refresh() {
+        drogon::orm::DbClientPtr db = drogon::app().getDbClient();
+        const int64_t now = hanaru::timeFromEpoch();
+
+        // Ranked and approved beatmaps cannot be changed, rows that were taken from .osu files are never checked, so they go first.
+        // Graveyard and WIP beatmaps are stored as pending.
+        db->execSqlAsync(
+            "SELECT beatmapset_id, MAX(ranked_status) AS ranked_status, MIN(checked_at) AS checked_at FROM beatmaps "
+            "WHERE ranked_status_freezed = 0 AND ("
+            "(ranked_status = ? AND checked_at < ?) OR "
+            "(ranked_status = ? AND checked_at < ?) OR "
+            "(ranked_status IN (?, ?) AND checked_at < ?)"
+            ") GROUP BY beatmapset_id ORDER BY MIN(checked_at) ASC LIMIT ?;",
+            [now](const drogon::orm::Result& result) {
+                std::vector<RefreshCandidate> candidates {};
+                candidates.reserve(result.size());
+
+                for (const auto& row : result) {
+                    const uint64_t cooldown = cooldownOf(row["ranked_status"].as<int32_t>());
+                    if (cooldown == 0) {
+                        continue;
+                    }
+
+                    const double staleness = static_cast<double>(now - row["checked_at"].as<int64_t>()) / static_cast<double>(cooldown);
+                    RefreshCandidate candidate {};
+
+                    candidate.id = row["beatmapset_id"].as<int64_t>();
+                    candidate.weight = std::min(staleness, maxStaleness) * (1.0 + std::log2(1.0 + static_cast<double>(hanaru::storage::accessCount(candidate.id))));
+
+                    candidates.push_back(candidate);
+                }
+
+                const size_t amount = std::min<size_t>(candidates.size(), refreshBatchSize_);
+                std::partial_sort(candidates.begin(), candidates.begin() + amount, candidates.end(), [](const RefreshCandidate& lhs, const RefreshCandidate& rhs) {
+                    return lhs.weight > rhs.weight;
+                });
+
+                for (size_t i = 0; i < amount; i++) {
+                    // Same price as in /s/ route, if we out of tokens then users should be served first
+                    if (!hanaru::verifyRateLimit(10)) {
+                        return;
+                    }
+
+                    refreshBeatmapset(candidates[i].id);
+                }
+            },
+            [](const drogon::orm::DrogonDbException&) {},
+            static_cast<int32_t>(hanaru::RankedStatus::Qualified),
+            checkedBefore(qualifiedCooldown_, now),
+            static_cast<int32_t>(hanaru::RankedStatus::Loved),
+            checkedBefore(lovedCooldown_, now),
+            static_cast<int32_t>(hanaru::RankedStatus::Pending),
+            static_cast<int32_t>(hanaru::RankedStatus::Unknown),
+            checkedBefore(pendingCooldown_, now),
+            // Taking more rows than needed, so popular beatmapsets will be chosen over unpopular ones
+            static_cast<int64_t>(refreshBatchSize_ * 20)
+        );
+    }
+
+}
+
+namespace hanaru {
+
+    void refresher::initialize(uint64_t interval, uint64_t batchSize, uint64_t qualifiedCooldown, uint64_t lovedCooldown, uint64_t pendingCooldown) {
+        if (interval == 0 || batchSize == 0) {
+            return;
+        }
+
+        detail::refreshBatchSize_ = batchSize;
+        detail::qualifiedCooldown_ = qualifiedCooldown;
+        detail::lovedCooldown_ = lovedCooldown;
+        detail::pendingCooldown_ = pendingCooldown;
+
+        drogon::app().getLoop()->runEvery(static_cast<double>(interval), &detail::refresh);
+    }
+
+}
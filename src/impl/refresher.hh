@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdint>
+
+namespace hanaru {
+
+    namespace refresher {
+
+        // Periodically asks osu! about metadata of qualified, loved and pending beatmapsets, so their rows in `beatmaps` don't go stale.
+        // Every `interval` seconds up to `batchSize` beatmapsets are refreshed, each status has own cooldown in seconds (0 means never refreshed).
+        // Beatmapsets that are overdue the most and requested the most are refreshed first, freezed beatmaps are skipped.
+        // Interval of 0 disables refreshing.
+        void initialize(uint64_t interval, uint64_t batchSize, uint64_t qualifiedCooldown, uint64_t lovedCooldown, uint64_t pendingCooldown);
+
+    }
+
+}
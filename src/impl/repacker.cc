@@ -0,0 +1,127 @@
+#include "repacker.hh"
+
+#include "downloader.hh"
+#include "osu_file.hh"
+#include "utils.hh"
+
+#include <algorithm>
+#include <cctype>
+#include <fstream>
+#include <unordered_set>
+
+namespace detail {
+
+    // Names in .osu files are case insensitive and might use backslashes
+    std::string normalizePath(std::string str) {
+        std::transform(str.begin(), str.end(), str.begin(), [](unsigned char c) { return std::tolower(c); });
+        std::replace(str.begin(), str.end(), '\\', '/');
+        return str;
+    }
+
+    std::string repackLite(const hanaru::Beatmap& beatmap) {
+        std::unordered_set<std::string> required {};
+
+        for (const hanaru::ZipEntry& entry : beatmap.entries()) {
+            const std::string name = normalizePath(entry.name);
+            if (name.size() < 4 || name.compare(name.size() - 4, 4, ".osu") != 0) {
+                continue;
+            }
+
+            const std::optional<std::string> osuFile = hanaru::zip::extract(beatmap.content(), entry);
+            if (!osuFile.has_value()) {
+                continue;
+            }
+
+            required.insert(name);
+            required.insert(normalizePath(hanaru::osu_file::findAudio(osuFile.value())));
+            required.insert(normalizePath(hanaru::osu_file::findBackground(osuFile.value())));
+        }
+
+        // Storyboards, their sprites, custom hitsounds and skin elements are dropped
+        std::vector<hanaru::ZipEntry> entries {};
+        std::copy_if(beatmap.entries().begin(), beatmap.entries().end(), std::back_inserter(entries), [&required](const hanaru::ZipEntry& entry) {
+            return required.count(normalizePath(entry.name)) > 0;
+        });
+
+        if (entries.empty()) {
+            return {};
+        }
+
+        return hanaru::zip::repack(beatmap.content(), entries);
+    }
+
+    void sendLite(std::shared_ptr<const hanaru::Beatmap>&& beatmap, const std::function<void(std::tuple<drogon::HttpStatusCode, std::shared_ptr<const hanaru::Beatmap>, std::string>&&)>& callback) {
+        if (beatmap == nullptr || beatmap->content().empty()) {
+            callback({ drogon::k404NotFound, nullptr, "beatmapset doesn't have any difficulties" });
+            return;
+        }
+
+        callback({ drogon::k200OK, std::move(beatmap), "" });
+    }
+
+}
+
+namespace hanaru {
+
+    void repacker::downloadLiteMap(int64_t id, std::function<void(std::tuple<drogon::HttpStatusCode, std::shared_ptr<const Beatmap>, std::string>&&)>&& callback) {
+        if (!verifyRateLimit(1)) {
+            callback({ drogon::k429TooManyRequests, nullptr, "rate limit, please try again" });
+            return;
+        }
+
+        if (auto sBeatmap = storage::findLite(id)) {
+            storage::recordAccess(id);
+            detail::sendLite(std::move(sBeatmap), callback);
+            return;
+        }
+
+        const std::filesystem::path litePath = storage::resolvePath(id, ".lite");
+
+        storage::runTask([id, litePath, callback = std::move(callback)]() mutable {
+            // Name is the same as full archive has, so it must be taken from database
+            if (storage::hasFile(id, ".lite")) {
+                storage::recordAccess(id);
+                std::string contents = storage::readFile(litePath);
+                drogon::orm::DbClientPtr db = drogon::app().getDbClient();
+
+                db->execSqlAsync("SELECT name FROM beatmaps_names WHERE id = ? LIMIT 1;",
+                    [id, contents_ = std::move(contents), callback](const drogon::orm::Result& result) mutable {
+                        std::string filename = std::to_string(id) + ".osz";
+
+                        if (!result.empty()) {
+                            filename = result.front()["name"].as<std::string>();
+                        }
+
+                        detail::sendLite(storage::insertLite(id, std::move(filename), std::move(contents_)), callback);
+                    },
+                    [callback](const drogon::orm::DrogonDbException&) { callback({ drogon::k500InternalServerError, nullptr, "something went wrong, please report me!" }); }, id
+                );
+                return;
+            }
+
+            downloader::downloadMap(id, [id, litePath, callback = std::move(callback)](std::tuple<drogon::HttpStatusCode, std::shared_ptr<const Beatmap>, std::string>&& result) mutable {
+                auto& [code, beatmap, error] = result;
+
+                if (beatmap == nullptr) {
+                    callback({ code, nullptr, std::move(error) });
+                    return;
+                }
+
+                storage::runTask([id, litePath, beatmap = std::move(beatmap), callback = std::move(callback)]() {
+                    std::string contents = detail::repackLite(*beatmap);
+
+                    if (storage::canWrite()) {
+                        std::ofstream liteFile { litePath, std::ios::binary };
+                        liteFile << contents;
+
+                        liteFile.close();
+                        storage::commitFile(id, litePath);
+                    }
+
+                    detail::sendLite(storage::insertLite(id, std::string { beatmap->name() }, std::move(contents)), callback);
+                });
+            });
+        });
+    }
+
+}
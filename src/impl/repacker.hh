@@ -0,0 +1,18 @@
+#pragma once
+
+#include <drogon/HttpAppFramework.h>
+
+#include "storage_manager.hh"
+
+namespace hanaru {
+
+    namespace repacker {
+
+        // Returns archive which contains only .osu files, their audio and backgrounds.
+        // Lite archive is built once from full archive and stored next to it, so next requests are served from disk or memory.
+        // On success beatmap is not null, otherwise string contains reason of failure
+        void downloadLiteMap(int64_t id, std::function<void(std::tuple<drogon::HttpStatusCode, std::shared_ptr<const Beatmap>, std::string>&&)>&& callback);
+
+    }
+
+}
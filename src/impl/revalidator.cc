@@ -0,0 +1,141 @@
+#include "revalidator.hh"
+
+#include "downloader.hh"
+#include "storage_manager.hh"
+#include "utils.hh"
+
+#include <drogon/HttpAppFramework.h>
+
+#include <algorithm>
+
+namespace detail {
+
+    class RevalidationCandidate {
+    public:
+        int64_t id = 0;
+        int64_t latestUpdate = 0;
+        int32_t rankedStatus = 0;
+        uint64_t popularity = 0;
+    };
+
+    uint64_t revalidationCooldown_ = 0;
+    uint64_t revalidationBatchSize_ = 0;
+
+    void updateArchiveTags(int64_t id, int64_t latestUpdate, int32_t rankedStatus) {
+        drogon::orm::DbClientPtr db = drogon::app().getDbClient();
+
+        db->execSqlAsync(
+            "UPDATE beatmaps_names SET latest_update = ?, ranked_status = ?, checked_at = ? WHERE id = ?;",
+            [](const drogon::orm::Result&) {},
+            [](const drogon::orm::DrogonDbException&) {},
+            latestUpdate, rankedStatus, hanaru::timeFromEpoch(), id
+        );
+    }
+
+    void revalidateArchive(const RevalidationCandidate& candidate) {
+        hanaru::downloader::downloadBeatmapset(candidate.id, [candidate](std::tuple<Json::Value, drogon::HttpStatusCode>&& result) {
+            const auto& [beatmaps, code] = result;
+
+            // Beatmapset might be deleted or osu! is unavailable, anyway we cannot say anything about archive
+            if (code != drogon::k200OK || beatmaps.empty()) {
+                updateArchiveTags(candidate.id, candidate.latestUpdate, candidate.rankedStatus);
+                return;
+            }
+
+            int64_t upstreamUpdate = 0;
+            for (const Json::Value& beatmap : beatmaps) {
+                upstreamUpdate = std::max(upstreamUpdate, hanaru::stringToTime(beatmap["latest_update"]));
+            }
+
+            const int32_t rankedStatus = beatmaps[0]["ranked_status"].asInt();
+
+            if (upstreamUpdate <= candidate.latestUpdate) {
+                updateArchiveTags(candidate.id, candidate.latestUpdate, rankedStatus);
+                return;
+            }
+
+            // Leaving tags untouched, so this beatmapset will be picked up again on next iteration
+            if (!hanaru::verifyRateLimit(40)) {
+                return;
+            }
+
+            hanaru::downloader::fetchMap(candidate.id, [candidate, upstreamUpdate, rankedStatus](std::tuple<drogon::HttpStatusCode, std::shared_ptr<const hanaru::Beatmap>, std::string>&& result) {
+                const auto& [code, beatmap, error] = result;
+
+                if (beatmap == nullptr) {
+                    LOG_WARN << "Failed to revalidate beatmapset " << candidate.id << ": " << error;
+                    updateArchiveTags(candidate.id, candidate.latestUpdate, rankedStatus);
+                    return;
+                }
+
+                LOG_INFO << "Beatmapset " << candidate.id << " was updated on osu!, archive replaced";
+                updateArchiveTags(candidate.id, upstreamUpdate, rankedStatus);
+            }, hanaru::Priority::Background);
+        }, hanaru::Priority::Background);
+    }
+
+    void revalidateArchives() {
+        drogon::orm::DbClientPtr db = drogon::app().getDbClient();
+        const int64_t checkedBefore = hanaru::timeFromEpoch() - static_cast<int64_t>(revalidationCooldown_);
+
+        // Ranked, approved and loved beatmapsets cannot be changed, so as beatmapsets with freezed status
+        db->execSqlAsync(
+            "SELECT n.id, n.latest_update, n.ranked_status FROM beatmaps_names n "
+            "WHERE n.ranked_status NOT IN (?, ?, ?) AND n.checked_at < ? "
+            "AND NOT EXISTS (SELECT 1 FROM beatmaps b WHERE b.beatmapset_id = n.id AND b.ranked_status_freezed = 1) "
+            "ORDER BY n.checked_at ASC LIMIT ?;",
+            [](const drogon::orm::Result& result) {
+                std::vector<RevalidationCandidate> candidates {};
+                candidates.reserve(result.size());
+
+                for (const auto& row : result) {
+                    RevalidationCandidate candidate {};
+
+                    candidate.id = row["id"].as<int64_t>();
+                    candidate.latestUpdate = row["latest_update"].as<int64_t>();
+                    candidate.rankedStatus = row["ranked_status"].as<int32_t>();
+                    candidate.popularity = hanaru::storage::accessCount(candidate.id);
+
+                    candidates.push_back(candidate);
+                }
+
+                const size_t amount = std::min<size_t>(candidates.size(), revalidationBatchSize_);
+                std::partial_sort(candidates.begin(), candidates.begin() + amount, candidates.end(), [](const RevalidationCandidate& lhs, const RevalidationCandidate& rhs) {
+                    return lhs.popularity > rhs.popularity;
+                });
+
+                for (size_t i = 0; i < amount; i++) {
+                    // Same price as in /s/ route, if we out of tokens then users should be served first
+                    if (!hanaru::verifyRateLimit(10)) {
+                        return;
+                    }
+
+                    revalidateArchive(candidates[i]);
+                }
+            },
+            [](const drogon::orm::DrogonDbException&) {},
+            static_cast<int32_t>(hanaru::RankedStatus::Ranked),
+            static_cast<int32_t>(hanaru::RankedStatus::Approved),
+            static_cast<int32_t>(hanaru::RankedStatus::Loved),
+            checkedBefore,
+            // Taking more rows than needed, so popular beatmapsets will be chosen over unpopular ones
+            static_cast<int64_t>(revalidationBatchSize_ * 20)
+        );
+    }
+
+}
+
+namespace hanaru {
+
+    void revalidator::initialize(uint64_t interval, uint64_t cooldown, uint64_t batchSize) {
+        if (interval == 0 || batchSize == 0) {
+            return;
+        }
+
+        detail::revalidationCooldown_ = cooldown;
+        detail::revalidationBatchSize_ = batchSize;
+
+        drogon::app().getLoop()->runEvery(static_cast<double>(interval), &detail::revalidateArchives);
+    }
+
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstdint>
+
+namespace hanaru {
+
+    namespace revalidator {
+
+        // Periodically compares stored archives of non-ranked beatmapsets with osu! and replaces outdated ones.
+        // Every `interval` seconds up to `batchSize` most popular beatmapsets are checked,
+        // each beatmapset is checked not often than once per `cooldown` seconds.
+        // Interval of 0 disables revalidation.
+        void initialize(uint64_t interval, uint64_t cooldown, uint64_t batchSize);
+
+    }
+
+}
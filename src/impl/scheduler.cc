@@ -0,0 +1,182 @@
+#include "scheduler.hh"
+
+#include <drogon/HttpAppFramework.h>
+
+#include <array>
+#include <chrono>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+namespace detail {
+
+    using Clock = std::chrono::steady_clock;
+
+    class PendingTransfer {
+    public:
+        std::function<void(hanaru::scheduler::SlotPtr)> task {};
+        std::function<void()> onExpired {};
+        Clock::time_point scheduledAt {};
+    };
+
+    class PriorityClass {
+    public:
+        size_t limit = 0;
+        size_t active = 0;
+        std::deque<PendingTransfer> queue {};
+    };
+
+    constexpr size_t priorityClasses = 3;
+
+    std::mutex schedulerMutex_ {};
+    std::array<PriorityClass, priorityClasses> classes_ {};
+    Clock::duration maxWait_ = Clock::duration::zero();
+
+    bool expired(const PendingTransfer& transfer, Clock::time_point now) {
+        return maxWait_ != Clock::duration::zero() && now - transfer.scheduledAt > maxWait_;
+    }
+
+    void release(hanaru::Priority priority);
+
+}
+
+namespace hanaru {
+
+    class scheduler::Slot {
+    public:
+        explicit Slot(Priority priority) : priority_ { priority } {}
+        ~Slot() { detail::release(priority_); }
+
+        Slot(const Slot&) = delete;
+        Slot& operator=(const Slot&) = delete;
+
+    private:
+        Priority priority_;
+    };
+
+}
+
+namespace detail {
+
+    // Schedules everything outside of lock and outside of thread that released slot, which usually is curl thread
+    void dispatch(std::vector<PendingTransfer>&& started, hanaru::Priority priority, std::vector<PendingTransfer>&& expired) {
+        if (started.empty() && expired.empty()) {
+            return;
+        }
+
+        drogon::app().getLoop()->queueInLoop([started = std::move(started), priority, expired = std::move(expired)]() mutable {
+            for (PendingTransfer& transfer : expired) {
+                transfer.onExpired();
+            }
+
+            for (PendingTransfer& transfer : started) {
+                transfer.task(std::make_shared<hanaru::scheduler::Slot>(priority));
+            }
+        });
+    }
+
+    // Lock must be held by caller, moves transfers that can be started or must be rejected out of queue
+    void drain(PriorityClass& priorityClass, std::vector<PendingTransfer>& started, std::vector<PendingTransfer>& expiredTransfers) {
+        const Clock::time_point now = Clock::now();
+
+        while (!priorityClass.queue.empty()) {
+            PendingTransfer& transfer = priorityClass.queue.front();
+
+            if (expired(transfer, now)) {
+                expiredTransfers.push_back(std::move(transfer));
+                priorityClass.queue.pop_front();
+                continue;
+            }
+
+            if (priorityClass.limit != 0 && priorityClass.active >= priorityClass.limit) {
+                break;
+            }
+
+            priorityClass.active++;
+            started.push_back(std::move(transfer));
+            priorityClass.queue.pop_front();
+        }
+    }
+
+    void release(hanaru::Priority priority) {
+        std::vector<PendingTransfer> started {};
+        std::vector<PendingTransfer> expiredTransfers {};
+
+        {
+            std::unique_lock<std::mutex> lock { schedulerMutex_ };
+            PriorityClass& priorityClass = classes_[static_cast<size_t>(priority)];
+
+            priorityClass.active--;
+            drain(priorityClass, started, expiredTransfers);
+        }
+
+        dispatch(std::move(started), priority, std::move(expiredTransfers));
+    }
+
+    // Requests can be stuck in queue if every slot is taken by long transfer, so they are rejected periodically as well
+    void rejectExpired() {
+        for (size_t i = 0; i < priorityClasses; i++) {
+            std::vector<PendingTransfer> started {};
+            std::vector<PendingTransfer> expiredTransfers {};
+
+            {
+                std::unique_lock<std::mutex> lock { schedulerMutex_ };
+                drain(classes_[i], started, expiredTransfers);
+            }
+
+            dispatch(std::move(started), static_cast<hanaru::Priority>(i), std::move(expiredTransfers));
+        }
+    }
+
+}
+
+namespace hanaru {
+
+    void scheduler::initialize(size_t interactiveLimit, size_t backgroundLimit, size_t bulkLimit, uint64_t maxWait) {
+        detail::classes_[static_cast<size_t>(Priority::Interactive)].limit = interactiveLimit;
+        detail::classes_[static_cast<size_t>(Priority::Background)].limit = backgroundLimit;
+        detail::classes_[static_cast<size_t>(Priority::Bulk)].limit = bulkLimit;
+        detail::maxWait_ = std::chrono::seconds(maxWait);
+
+        if (maxWait == 0) {
+            return;
+        }
+
+        drogon::app().getLoop()->runEvery(1.0, &detail::rejectExpired);
+    }
+
+    void scheduler::schedule(Priority priority, std::function<void(SlotPtr)>&& task, std::function<void()>&& onExpired) {
+        {
+            std::unique_lock<std::mutex> lock { detail::schedulerMutex_ };
+            detail::PriorityClass& priorityClass = detail::classes_[static_cast<size_t>(priority)];
+
+            // Queue is not empty only if class is full, so FIFO order is preserved
+            if (!priorityClass.queue.empty() || (priorityClass.limit != 0 && priorityClass.active >= priorityClass.limit)) {
+                priorityClass.queue.push_back({ std::move(task), std::move(onExpired), detail::Clock::now() });
+                return;
+            }
+
+            priorityClass.active++;
+        }
+
+        task(std::make_shared<Slot>(priority));
+    }
+
+    size_t scheduler::activeTransfers(Priority priority) {
+        std::unique_lock<std::mutex> lock { detail::schedulerMutex_ };
+        return detail::classes_[static_cast<size_t>(priority)].active;
+    }
+
+    size_t scheduler::queuedTransfers(Priority priority) {
+        std::unique_lock<std::mutex> lock { detail::schedulerMutex_ };
+        return detail::classes_[static_cast<size_t>(priority)].queue.size();
+    }
+
+    bool scheduler::hasFreeSlot(Priority priority) {
+        std::unique_lock<std::mutex> lock { detail::schedulerMutex_ };
+        const detail::PriorityClass& priorityClass = detail::classes_[static_cast<size_t>(priority)];
+
+        return priorityClass.queue.empty() && (priorityClass.limit == 0 || priorityClass.active < priorityClass.limit);
+    }
+
+}
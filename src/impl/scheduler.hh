@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+
+namespace hanaru {
+
+    // Classes of requests to osu!, each class has own limit of concurrent transfers, so bulk jobs cannot starve users
+    enum class Priority : uint8_t {
+        // Requests made on behalf of client that waits for response
+        Interactive = 0,
+        // Revalidation and other periodic jobs
+        Background = 1,
+        // Large jobs that can wait, like crawling and prefetching
+        Bulk = 2
+    };
+
+    namespace scheduler {
+
+        class Slot;
+        // Holds transfer slot of priority class, slot is released when last copy is destroyed
+        using SlotPtr = std::shared_ptr<Slot>;
+
+        // Limit of 0 means that priority class is not limited.
+        // Requests that waited for free slot longer than `maxWait` seconds are rejected, 0 means that they can wait forever.
+        void initialize(size_t interactiveLimit, size_t backgroundLimit, size_t bulkLimit, uint64_t maxWait);
+
+        // Runs task as soon as priority class has free slot, tasks of same class are started in order of scheduling.
+        // Slot must be kept alive by task until transfer is done, e.g. by capturing it into request callbacks.
+        // If slot wasn't given in time, onExpired is called instead of task.
+        void schedule(Priority priority, std::function<void(SlotPtr)>&& task, std::function<void()>&& onExpired);
+
+        size_t activeTransfers(Priority priority);
+        size_t queuedTransfers(Priority priority);
+        // Returns true if task of priority class would be started right away
+        bool hasFreeSlot(Priority priority);
+
+    }
+
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace hanaru {
+
+    // Coalesces concurrent requests for the same key, so expensive work is done only once.
+    // First caller of join becomes leader and must call complete, everyone else just waits for result.
+    template <typename K, typename R>
+    class SingleFlight {
+    public:
+        using KeyT = K;
+        using ResultT = R;
+        using CallbackT = std::function<void(ResultT&&)>;
+
+        SingleFlight() = default;
+        ~SingleFlight() = default;
+
+        // Returns true if caller is leader and must start work
+        bool join(const KeyT& key, CallbackT&& callback);
+        // Delivers result to every waiter of key, callbacks are invoked outside of lock
+        void complete(const KeyT& key, ResultT&& result);
+
+    private:
+        std::mutex mutex_ {};
+        std::unordered_map<KeyT, std::vector<CallbackT>> waiters_ {};
+    };
+
+    template <typename K, typename R>
+    inline bool SingleFlight<K, R>::join(const KeyT& key, CallbackT&& callback) {
+        std::unique_lock<std::mutex> lock { mutex_ };
+
+        auto [it, inserted] = waiters_.try_emplace(key);
+        it->second.push_back(std::move(callback));
+        return inserted;
+    }
+
+    template <typename K, typename R>
+    inline void SingleFlight<K, R>::complete(const KeyT& key, ResultT&& result) {
+        std::vector<CallbackT> callbacks {};
+
+        {
+            std::unique_lock<std::mutex> lock { mutex_ };
+
+            auto it = waiters_.find(key);
+            if (it == waiters_.end()) {
+                return;
+            }
+
+            callbacks = std::move(it->second);
+            waiters_.erase(it);
+        }
+
+        // Every waiter except the last one receives own copy
+        for (size_t i = 0; i + 1 < callbacks.size(); i++) {
+            ResultT copy = result;
+            callbacks[i](std::move(copy));
+        }
+
+        callbacks.back()(std::move(result));
+    }
+
+}
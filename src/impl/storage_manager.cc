@@ -1,19 +1,546 @@
 #include "storage_manager.hh"
 
 #include <drogon/HttpAppFramework.h>
+#include <trantor/utils/ConcurrentTaskQueue.h>
 
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <charconv>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
 #include <thread>
+#include <unordered_map>
 
 #include "../thirdparty/concurrent_cache.hh"
 
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
 namespace detail {
 
-    // Hard drive information
-    std::atomic_size_t currentFreeSpace_ = 0;
-    std::size_t requiredFreeSpace_ = 0;
-    std::filesystem::path beatmapsPath {};
+    class Tier {
+    public:
+        std::filesystem::path path {};
+        // In bytes, 0 means unlimited
+        size_t capacity = 0;
+        std::atomic_size_t used = 0;
+        // Free space of drive, taken only at the start of the program
+        std::atomic_size_t freeSpace = 0;
+
+        bool hasSpace() const noexcept {
+            return freeSpace > 0 && (capacity == 0 || used < capacity);
+        }
+    };
+
+    class TierLocation {
+    public:
+        size_t tier = 0;
+        size_t size = 0;
+        // Bit per each of beatmapsetExtensions, 0 means that beatmapset has no files
+        uint8_t files = 0;
+    };
+
+    class BeatmapsetFile {
+    public:
+        int64_t id = 0;
+        size_t extension = 0;
+    };
+
+    class TieringCandidate {
+    public:
+        int64_t id = 0;
+        size_t tier = 0;
+        size_t size = 0;
+        uint64_t popularity = 0;
+    };
+
+    // Archive itself, thumbnail and lite archive, all of them must be moved together
+    constexpr std::array<std::string_view, 3> beatmapsetExtensions = { "", ".jpg", ".lite" };
+    // Fast tiers are filled only up to this part of capacity, so new beatmapsets always have place to go
+    constexpr double tierFillRatio = 0.9;
+    constexpr size_t maxMovesPerPass = 64;
+
+    std::vector<std::unique_ptr<Tier>> tiers_ {};
+
+    std::shared_mutex indexMutex_ {};
+    std::unordered_map<int64_t, TierLocation> index_ {};
+
+    // Set only while inotify watches every tier, otherwise index might miss changes made by others
+    std::atomic_bool watching_ = false;
+
+    std::atomic_bool balancing_ = false;
+    // Old copies are removed only on next pass, so readers that already resolved old path can finish
+    std::vector<std::filesystem::path> pendingRemoval_ {};
 
     cache::LRUCache<int64_t, hanaru::Beatmap> cache_ {};
+    cache::LRUCache<int64_t, hanaru::Beatmap> liteCache_ {};
+    // Empty thumbnail means that beatmapset has no background
+    cache::LRUCache<int64_t, std::string, 1024> thumbnailCache_ {};
+
+    std::unique_ptr<trantor::ConcurrentTaskQueue> worker_ {};
+
+    std::mutex accessMutex_ {};
+    std::unordered_map<int64_t, uint64_t> accessCounts_ {};
+
+    void changeFreeSpace(std::atomic_size_t& freeSpace, size_t added, size_t removed) noexcept {
+        size_t previousSpace = freeSpace.load(std::memory_order_relaxed);
+        size_t newSpace = 0;
+
+        do {
+            newSpace = previousSpace + added;
+            newSpace = newSpace < removed ? 0 : newSpace - removed;
+        } while (!freeSpace.compare_exchange_weak(previousSpace, newSpace, std::memory_order_relaxed, std::memory_order_relaxed));
+    }
+
+    std::filesystem::path beatmapsetPath(size_t tier, int64_t id, std::string_view extension) {
+        std::string filename = std::to_string(id);
+        filename += extension;
+        return tiers_[tier]->path / filename;
+    }
+
+    TierLocation inspectBeatmapset(size_t tier, int64_t id) {
+        TierLocation location { tier, 0, 0 };
+
+        for (size_t i = 0; i < beatmapsetExtensions.size(); i++) {
+            std::error_code ec {};
+            const uintmax_t fileSize = std::filesystem::file_size(beatmapsetPath(tier, id, beatmapsetExtensions[i]), ec);
+
+            if (!ec) {
+                location.size += static_cast<size_t>(fileSize);
+                location.files |= 1 << i;
+            }
+        }
+
+        return location;
+    }
+
+    std::optional<BeatmapsetFile> parseBeatmapsetFile(std::string_view filename) {
+        const size_t dot = filename.find('.');
+        const std::string_view extension = dot == std::string_view::npos ? std::string_view {} : filename.substr(dot);
+
+        const auto it = std::find(beatmapsetExtensions.begin(), beatmapsetExtensions.end(), extension);
+        if (it == beatmapsetExtensions.end()) {
+            return std::nullopt;
+        }
+
+        int64_t id = 0;
+        const char* last = filename.data() + (dot == std::string_view::npos ? filename.size() : dot);
+        const auto [ptr, ec] = std::from_chars(filename.data(), last, id);
+
+        if (ec != std::errc() || ptr != last) {
+            return std::nullopt;
+        }
+
+        return BeatmapsetFile { id, static_cast<size_t>(std::distance(beatmapsetExtensions.begin(), it)) };
+    }
+
+    // Index lock must be held by caller
+    void scanTier(size_t tier) {
+        std::unordered_map<int64_t, TierLocation> locations {};
+        std::error_code ec {};
+
+        for (const auto& file : std::filesystem::directory_iterator(tiers_[tier]->path, ec)) {
+            std::error_code fileEc {};
+            if (!file.is_regular_file(fileEc)) {
+                continue;
+            }
+
+            if (const auto beatmapsetFile = parseBeatmapsetFile(file.path().filename().string())) {
+                const uintmax_t fileSize = file.file_size(fileEc);
+
+                TierLocation& location = locations.try_emplace(beatmapsetFile->id, TierLocation { tier, 0, 0 }).first->second;
+                location.size += fileEc ? 0 : static_cast<size_t>(fileSize);
+                location.files |= 1 << beatmapsetFile->extension;
+            }
+        }
+
+        for (const auto& [id, location] : locations) {
+            const auto [it, inserted] = index_.try_emplace(id, location);
+
+            // Might happen if hanaru was stopped in the middle of moving
+            if (!inserted) {
+                LOG_WARN << "Beatmapset " << id << " exists in multiple tiers, copy from " << tiers_[tier]->path << " is ignored";
+                continue;
+            }
+
+            tiers_[tier]->used += location.size;
+        }
+    }
+
+    void rescanTiers() {
+        std::unique_lock<std::shared_mutex> lock { indexMutex_ };
+
+        index_.clear();
+        for (size_t tier = 0; tier < tiers_.size(); tier++) {
+            tiers_[tier]->used = 0;
+            scanTier(tier);
+        }
+    }
+
+    // Re-reads files of beatmapset in provided tier, copies in other tiers than indexed one are ignored
+    void updateLocation(int64_t id, size_t tier) {
+        const TierLocation location = inspectBeatmapset(tier, id);
+        size_t previousSize = 0;
+
+        {
+            std::unique_lock<std::shared_mutex> lock { indexMutex_ };
+            const auto it = index_.find(id);
+
+            if (it != index_.end() && it->second.tier != tier && it->second.files != 0) {
+                return;
+            }
+
+            if (it != index_.end()) {
+                previousSize = it->second.tier == tier ? it->second.size : 0;
+            }
+
+            if (location.files == 0) {
+                if (it != index_.end()) {
+                    index_.erase(it);
+                }
+            }
+            else {
+                index_[id] = location;
+            }
+        }
+
+        tiers_[tier]->used += location.size;
+        tiers_[tier]->used -= std::min(previousSize, tiers_[tier]->used.load());
+        changeFreeSpace(tiers_[tier]->freeSpace, previousSize, location.size);
+    }
+
+    template <typename T>
+    void invalidateCache(T& cache, int64_t id, const std::filesystem::path& path) {
+        const auto cached = cache.find(id);
+
+        // Own writes are reported by inotify as well, they are the same as cached ones
+        std::error_code ec {};
+        const uintmax_t fileSize = std::filesystem::file_size(path, ec);
+        if (cached != nullptr && !ec && cached->size() == fileSize) {
+            return;
+        }
+
+        cache.erase(id);
+    }
+
+    // Thumbnail and lite archive are built from archive, so ones written before archive was replaced are stale
+    void removeDerivedFiles(size_t tier, int64_t id, std::filesystem::file_time_type replacedAt = std::filesystem::file_time_type::max()) {
+        for (std::string_view extension : { std::string_view { ".jpg" }, std::string_view { ".lite" } }) {
+            const std::filesystem::path path = beatmapsetPath(tier, id, extension);
+
+            std::error_code ec {};
+            const std::filesystem::file_time_type writtenAt = std::filesystem::last_write_time(path, ec);
+
+            if (!ec && writtenAt < replacedAt) {
+                std::filesystem::remove(path, ec);
+            }
+        }
+
+        thumbnailCache_.erase(id);
+        liteCache_.erase(id);
+    }
+
+    void handleFileChange(size_t tier, const BeatmapsetFile& file) {
+        // Copies made and removed while beatmapset is moved between tiers don't change beatmapset itself
+        {
+            std::shared_lock<std::shared_mutex> lock { indexMutex_ };
+
+            const auto it = index_.find(file.id);
+            if (it != index_.end() && it->second.tier != tier && it->second.files != 0) {
+                return;
+            }
+        }
+
+        const std::filesystem::path path = beatmapsetPath(tier, file.id, beatmapsetExtensions[file.extension]);
+
+        if (file.extension == 0) {
+            invalidateCache(cache_, file.id, path);
+
+            // Tier moves and own downloads write archive before files derived from it, so only archives replaced by others are caught here
+            std::error_code ec {};
+            const std::filesystem::file_time_type replacedAt = std::filesystem::last_write_time(path, ec);
+            if (!ec) {
+                removeDerivedFiles(tier, file.id, replacedAt);
+            }
+        }
+        else if (beatmapsetExtensions[file.extension] == ".jpg") {
+            invalidateCache(thumbnailCache_, file.id, path);
+        }
+        else if (beatmapsetExtensions[file.extension] == ".lite") {
+            invalidateCache(liteCache_, file.id, path);
+        }
+
+        updateLocation(file.id, tier);
+    }
+
+    void watchTiers() {
+#ifdef __linux__
+        const int fd = inotify_init1(IN_CLOEXEC);
+        if (fd < 0) {
+            LOG_WARN << "Failed to initialize inotify, storage index won't see changes made by others";
+            return;
+        }
+
+        std::unordered_map<int, size_t> watches {};
+        for (size_t tier = 0; tier < tiers_.size(); tier++) {
+            const int wd = inotify_add_watch(fd, tiers_[tier]->path.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE | IN_DELETE_SELF | IN_MOVE_SELF);
+
+            if (wd < 0) {
+                LOG_WARN << "Failed to watch " << tiers_[tier]->path << ", storage index won't see changes made by others";
+                close(fd);
+                return;
+            }
+
+            watches[wd] = tier;
+        }
+
+        watching_ = true;
+
+        std::thread([fd, watches = std::move(watches)]() {
+            alignas(inotify_event) char buffer[64 * 1024];
+
+            while (true) {
+                const ssize_t length = read(fd, buffer, sizeof(buffer));
+
+                if (length <= 0) {
+                    if (length < 0 && errno == EINTR) {
+                        continue;
+                    }
+
+                    break;
+                }
+
+                for (ssize_t offset = 0; offset < length;) {
+                    const inotify_event* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+                    offset += sizeof(inotify_event) + event->len;
+
+                    // Some events were lost, so index cannot be trusted anymore
+                    if (event->mask & IN_Q_OVERFLOW) {
+                        LOG_WARN << "inotify queue overflowed, rescanning storage tiers";
+                        rescanTiers();
+                        cache_.clear();
+                        liteCache_.clear();
+                        thumbnailCache_.clear();
+                        continue;
+                    }
+
+                    if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) {
+                        LOG_WARN << "Storage tier was removed or moved, falling back to filesystem lookups";
+                        watching_ = false;
+                        continue;
+                    }
+
+                    const auto it = watches.find(event->wd);
+                    if (event->len == 0 || it == watches.end()) {
+                        continue;
+                    }
+
+                    if (const auto file = parseBeatmapsetFile(event->name)) {
+                        handleFileChange(it->second, file.value());
+                    }
+                }
+            }
+
+            watching_ = false;
+            close(fd);
+        }).detach();
+#endif
+    }
+
+    // Index lock must not be held by caller
+    bool isIndexedIn(int64_t id, size_t tier) {
+        std::shared_lock<std::shared_mutex> lock { indexMutex_ };
+
+        const auto it = index_.find(id);
+        return it != index_.end() && it->second.tier == tier;
+    }
+
+    // Refuses to move beatmapset that isn't in source tier anymore, otherwise stale copy would replace the current one
+    bool moveBeatmapset(int64_t id, size_t from, size_t to) {
+        if (!isIndexedIn(id, from)) {
+            return false;
+        }
+
+        std::vector<std::filesystem::path> copied {};
+
+        for (std::string_view extension : beatmapsetExtensions) {
+            const std::filesystem::path source = beatmapsetPath(from, id, extension);
+            const std::filesystem::path destination = beatmapsetPath(to, id, extension);
+
+            if (!std::filesystem::exists(source)) {
+                continue;
+            }
+
+            std::filesystem::path temporaryPath = destination;
+            temporaryPath += ".part";
+
+            std::error_code ec {};
+            std::filesystem::copy_file(source, temporaryPath, std::filesystem::copy_options::overwrite_existing, ec);
+
+            if (!ec) {
+                std::filesystem::rename(temporaryPath, destination, ec);
+            }
+
+            if (ec) {
+                LOG_WARN << "Failed to move beatmapset " << id << " into " << tiers_[to]->path << ": " << ec.message();
+
+                std::filesystem::remove(temporaryPath, ec);
+                for (const std::filesystem::path& path : copied) {
+                    std::filesystem::remove(path, ec);
+                }
+
+                return false;
+            }
+
+            copied.push_back(destination);
+        }
+
+        size_t size = 0;
+        {
+            std::unique_lock<std::shared_mutex> lock { indexMutex_ };
+            const auto it = index_.find(id);
+
+            // Beatmapset was removed or rewritten while it was copied
+            if (it == index_.end() || it->second.tier != from) {
+                lock.unlock();
+
+                std::error_code ec {};
+                for (const std::filesystem::path& path : copied) {
+                    std::filesystem::remove(path, ec);
+                }
+
+                return false;
+            }
+
+            size = it->second.size;
+            it->second.tier = to;
+        }
+
+        tiers_[from]->used -= std::min(size, tiers_[from]->used.load());
+        tiers_[to]->used += size;
+        changeFreeSpace(tiers_[from]->freeSpace, size, 0);
+        changeFreeSpace(tiers_[to]->freeSpace, 0, size);
+
+        for (std::string_view extension : beatmapsetExtensions) {
+            pendingRemoval_.push_back(beatmapsetPath(from, id, extension));
+        }
+
+        return true;
+    }
+
+    bool fitsInto(size_t tier, size_t size) {
+        const Tier& target = *tiers_[tier];
+        return target.capacity == 0
+            ? target.freeSpace > size
+            : target.used + size <= static_cast<size_t>(target.capacity * tierFillRatio);
+    }
+
+    void balanceTiers() {
+        std::error_code ec {};
+        for (const std::filesystem::path& path : pendingRemoval_) {
+            std::filesystem::remove(path, ec);
+        }
+        pendingRemoval_.clear();
+
+        // Moving is heavy, so it's done without holding index lock, index is updated per beatmapset instead
+        std::vector<std::vector<TieringCandidate>> residents(tiers_.size());
+        {
+            std::shared_lock<std::shared_mutex> lock { indexMutex_ };
+
+            for (const auto& [id, location] : index_) {
+                residents[location.tier].push_back({ id, location.tier, location.size, 0 });
+            }
+        }
+
+        for (auto& tier : residents) {
+            for (TieringCandidate& candidate : tier) {
+                candidate.popularity = hanaru::storage::accessCount(candidate.id);
+            }
+
+            std::sort(tier.begin(), tier.end(), [](const TieringCandidate& lhs, const TieringCandidate& rhs) {
+                return lhs.popularity < rhs.popularity;
+            });
+        }
+
+        size_t moves = 0;
+        std::vector<size_t> demoted(tiers_.size(), 0);
+
+        // Demoting coldest beatmapsets from tiers that are over their capacity
+        for (size_t tier = 0; tier + 1 < tiers_.size(); tier++) {
+            if (tiers_[tier]->capacity == 0) {
+                continue;
+            }
+
+            size_t& cursor = demoted[tier];
+            const size_t threshold = static_cast<size_t>(tiers_[tier]->capacity * tierFillRatio);
+
+            while (tiers_[tier]->used > threshold && cursor < residents[tier].size() && moves < maxMovesPerPass) {
+                TieringCandidate& candidate = residents[tier][cursor++];
+
+                if (!fitsInto(tier + 1, candidate.size) || !moveBeatmapset(candidate.id, tier, tier + 1)) {
+                    break;
+                }
+
+                candidate.tier = tier + 1;
+                moves++;
+            }
+        }
+
+        // Promoting popular beatmapsets, colder ones are swapped out if there is not enough place
+        for (size_t tier = 1; tier < tiers_.size(); tier++) {
+            std::vector<TieringCandidate>& upper = residents[tier - 1];
+            size_t& cursor = demoted[tier - 1];
+
+            for (auto it = residents[tier].rbegin(); it != residents[tier].rend() && moves < maxMovesPerPass; it++) {
+                if (it->popularity == 0) {
+                    break;
+                }
+
+                // Snapshot is shared by every tier, so beatmapsets that were already moved during this pass are skipped
+                if (it->tier != tier) {
+                    continue;
+                }
+
+                while (!fitsInto(tier - 1, it->size) && cursor < upper.size() && upper[cursor].popularity * 2 < it->popularity) {
+                    TieringCandidate& colder = upper[cursor++];
+
+                    if (colder.tier != tier - 1) {
+                        continue;
+                    }
+
+                    if (!moveBeatmapset(colder.id, tier - 1, tier)) {
+                        break;
+                    }
+
+                    colder.tier = tier;
+                    moves++;
+                }
+
+                if (!fitsInto(tier - 1, it->size) || !moveBeatmapset(it->id, tier, tier - 1)) {
+                    break;
+                }
+
+                it->tier = tier - 1;
+                moves++;
+            }
+        }
+
+        if (moves > 0) {
+            LOG_INFO << "Storage tiering moved " << moves << " beatmapsets";
+        }
+
+        // Popularity must reflect recent requests, otherwise beatmapsets that were popular long time ago will never leave fast tier
+        std::unique_lock<std::mutex> lock { accessMutex_ };
+        for (auto it = accessCounts_.begin(); it != accessCounts_.end();) {
+            it->second /= 2;
+            it = it->second == 0 ? accessCounts_.erase(it) : std::next(it);
+        }
+    }
 
 }
 
@@ -22,6 +549,7 @@ namespace hanaru {
     Beatmap::Beatmap(std::string&& name, std::string&& content)
         : name_ { std::move(name) }
         , content_ { std::move(content) }
+        , entries_ { zip::readCentralDirectory(content_) }
     {}
 
     const std::string& Beatmap::name() const {
@@ -36,13 +564,59 @@ namespace hanaru {
         return content_.size();
     }
 
-    void storage::initialize(std::string&& beatmapsPath, size_t requiredFreeSpace) {
-        detail::requiredFreeSpace_ = requiredFreeSpace;
+    const std::vector<ZipEntry>& Beatmap::entries() const {
+        return entries_;
+    }
 
-        std::filesystem::space_info si = std::filesystem::space(".");
-        detail::currentFreeSpace_ = si.available - (detail::requiredFreeSpace_ << 20);
+    const ZipEntry* Beatmap::findEntry(const std::string& name) const {
+        const auto it = std::find_if(entries_.begin(), entries_.end(), [&name](const ZipEntry& entry) {
+            return std::equal(entry.name.begin(), entry.name.end(), name.begin(), name.end(), [](unsigned char lhs, unsigned char rhs) {
+                return std::tolower(lhs) == std::tolower(rhs);
+            });
+        });
 
-        detail::beatmapsPath = beatmapsPath;
+        return it != entries_.end() ? &(*it) : nullptr;
+    }
+
+    void storage::initialize(std::vector<StorageTier>&& tiers, size_t requiredFreeSpace, uint64_t tieringInterval) {
+        const size_t requiredFreeSpaceInBytes = requiredFreeSpace << 20;
+
+        for (StorageTier& tier : tiers) {
+            std::error_code ec {};
+            std::filesystem::create_directories(tier.path, ec);
+
+            const std::filesystem::space_info si = std::filesystem::space(tier.path, ec);
+
+            auto& target = detail::tiers_.emplace_back(std::make_unique<detail::Tier>());
+            target->path = std::move(tier.path);
+            target->capacity = tier.capacity << 20;
+            target->freeSpace = !ec && si.available > requiredFreeSpaceInBytes ? si.available - requiredFreeSpaceInBytes : 0;
+
+            {
+                std::unique_lock<std::shared_mutex> lock { detail::indexMutex_ };
+                detail::scanTier(detail::tiers_.size() - 1);
+            }
+
+            LOG_INFO << "Storage tier " << target->path << ": " << (target->used >> 20) << " MB used";
+        }
+
+        detail::worker_ = std::make_unique<trantor::ConcurrentTaskQueue>(2, "storage");
+        detail::watchTiers();
+
+        if (tieringInterval == 0 || detail::tiers_.size() < 2) {
+            return;
+        }
+
+        drogon::app().getLoop()->runEvery(static_cast<double>(tieringInterval), []() {
+            if (detail::balancing_.exchange(true)) {
+                return;
+            }
+
+            runTask([]() {
+                detail::balanceTiers();
+                detail::balancing_ = false;
+            });
+        });
     }
 
     std::shared_ptr<const Beatmap> storage::insert(int64_t id, std::string&& name, std::string&& content) {
@@ -61,21 +635,104 @@ namespace hanaru {
         return detail::cache_.find(id);
     }
 
+    std::shared_ptr<const Beatmap> storage::insertLite(int64_t id, std::string&& name, std::string&& content) {
+        if (name.empty()) {
+            return {};
+        }
+
+        return detail::liteCache_.insert(id, { std::move(name), std::move(content) });
+    }
+
+    std::shared_ptr<const Beatmap> storage::findLite(int64_t id) {
+        return detail::liteCache_.find(id);
+    }
+
+    std::shared_ptr<const std::string> storage::insertThumbnail(int64_t id, std::string&& thumbnail) {
+        return detail::thumbnailCache_.insert(id, std::move(thumbnail));
+    }
+
+    std::shared_ptr<const std::string> storage::findThumbnail(int64_t id) {
+        return detail::thumbnailCache_.find(id);
+    }
+
+    void storage::runTask(std::function<void()>&& task) {
+        detail::worker_->runTaskInQueue(std::move(task));
+    }
+
+    void storage::recordAccess(int64_t id) {
+        std::unique_lock<std::mutex> lock { detail::accessMutex_ };
+        detail::accessCounts_[id]++;
+    }
+
+    uint64_t storage::accessCount(int64_t id) {
+        std::unique_lock<std::mutex> lock { detail::accessMutex_ };
+
+        const auto it = detail::accessCounts_.find(id);
+        return it != detail::accessCounts_.end() ? it->second : 0;
+    }
+
     bool storage::canWrite() noexcept {
-        return detail::currentFreeSpace_ > 0;
+        return std::any_of(detail::tiers_.begin(), detail::tiers_.end(), [](const auto& tier) { return tier->hasSpace(); });
     }
 
-    void storage::decreaseAvailableSpace(size_t memoryInBytes) noexcept {
-        size_t previousSpace = detail::currentFreeSpace_.load(std::memory_order_relaxed);
-        size_t newSpace = 0;
+    std::filesystem::path storage::resolvePath(int64_t id, std::string_view extension) {
+        {
+            std::shared_lock<std::shared_mutex> lock { detail::indexMutex_ };
 
-        do {
-            newSpace = previousSpace < memoryInBytes ? 0 : previousSpace - memoryInBytes;
-        } while (!detail::currentFreeSpace_.compare_exchange_weak(previousSpace, newSpace, std::memory_order_relaxed, std::memory_order_relaxed));
+            const auto it = detail::index_.find(id);
+            if (it != detail::index_.end()) {
+                return detail::beatmapsetPath(it->second.tier, id, extension);
+            }
+        }
+
+        const auto it = std::find_if(detail::tiers_.begin(), detail::tiers_.end(), [](const auto& tier) { return tier->hasSpace(); });
+        const size_t tier = it != detail::tiers_.end() ? std::distance(detail::tiers_.begin(), it) : detail::tiers_.size() - 1;
+
+        return detail::beatmapsetPath(tier, id, extension);
+    }
+
+    bool storage::hasFile(int64_t id, std::string_view extension) {
+        if (!detail::watching_) {
+            return std::filesystem::exists(resolvePath(id, extension));
+        }
+
+        const auto extensionIt = std::find(detail::beatmapsetExtensions.begin(), detail::beatmapsetExtensions.end(), extension);
+        const size_t bit = std::distance(detail::beatmapsetExtensions.begin(), extensionIt);
+
+        std::shared_lock<std::shared_mutex> lock { detail::indexMutex_ };
+
+        const auto it = detail::index_.find(id);
+        return it != detail::index_.end() && (it->second.files & (1 << bit));
     }
 
-    const std::filesystem::path& storage::getBeatmapsPath() noexcept {
-        return detail::beatmapsPath;
+    void storage::commitFile(int64_t id, const std::filesystem::path& path) {
+        const auto it = std::find_if(detail::tiers_.begin(), detail::tiers_.end(), [parent = path.parent_path()](const auto& tier) { return tier->path == parent; });
+        if (it == detail::tiers_.end()) {
+            return;
+        }
+
+        const size_t tier = std::distance(detail::tiers_.begin(), it);
+
+        if (path.filename() == std::to_string(id)) {
+            detail::removeDerivedFiles(tier, id);
+        }
+
+        detail::updateLocation(id, tier);
+    }
+
+    std::string storage::readFile(const std::filesystem::path& path) {
+        std::ifstream file { path, std::ios::binary };
+        if (!file.is_open()) {
+            return {};
+        }
+
+        std::string contents {};
+        file.seekg(0, std::ios::end);
+        contents.resize(file.tellg());
+        file.seekg(0, std::ios::beg);
+        file.read(contents.data(), contents.size());
+
+        return contents;
     }
 
 }
@@ -5,6 +5,10 @@
 #include <functional>
 #include <memory>
 #include <string>
+#include <string_view>
+#include <vector>
+
+#include "zip.hh"
 
 namespace hanaru {
 
@@ -17,22 +21,62 @@ namespace hanaru {
 
         size_t size() const;
 
+        // Central directory of archive, built once when beatmap is constructed
+        const std::vector<ZipEntry>& entries() const;
+        // Case-insensitive lookup of entry by its full name, returns nullptr if not found
+        const ZipEntry* findEntry(const std::string& name) const;
+
     private:
         std::string name_ {};
         std::string content_ {};
+        std::vector<ZipEntry> entries_ {};
+    };
+
+    // Directory where archives are stored, capacity is in megabytes and 0 means that tier is limited only by free space
+    class StorageTier {
+    public:
+        std::filesystem::path path {};
+        size_t capacity = 0;
     };
 
     namespace storage {
 
-        void initialize(std::string&& beatmapsPath, size_t requiredFreeSpace);
+        // Tiers must be ordered from fastest to slowest, new and popular beatmapsets are kept in the first one.
+        // Every `tieringInterval` seconds cold beatmapsets are moved to slower tiers and popular ones to faster, 0 disables it.
+        void initialize(std::vector<StorageTier>&& tiers, size_t requiredFreeSpace, uint64_t tieringInterval);
 
         std::shared_ptr<const Beatmap> insert(int64_t id, std::string&& name, std::string&& content);
         std::shared_ptr<const Beatmap> find(int64_t id);
 
+        // Same as insert and find, but for archives without storyboards and optional files.
+        // Empty lite archive is cached as well, it means that beatmapset doesn't have any difficulties
+        std::shared_ptr<const Beatmap> insertLite(int64_t id, std::string&& name, std::string&& content);
+        std::shared_ptr<const Beatmap> findLite(int64_t id);
+        // Same for thumbnails, empty thumbnail means that beatmapset has no background
+        std::shared_ptr<const std::string> insertThumbnail(int64_t id, std::string&& thumbnail);
+        std::shared_ptr<const std::string> findThumbnail(int64_t id);
+
+        // Runs task on background worker, must be used for heavy operations with archives or disk
+        void runTask(std::function<void()>&& task);
+
+        // Counts requests to beatmapset, used as popularity by background jobs
+        void recordAccess(int64_t id);
+        uint64_t accessCount(int64_t id);
+
         bool canWrite() noexcept;
-        void decreaseAvailableSpace(size_t memoryInBytes) noexcept;
 
-        const std::filesystem::path& getBeatmapsPath() noexcept;
+        // Returns path of beatmapset file with provided extension (archive itself has none).
+        // Files of single beatmapset always live in the same tier, unknown beatmapsets are placed in fastest tier with free space.
+        std::filesystem::path resolvePath(int64_t id, std::string_view extension = "");
+        // Checks whether beatmapset has file with provided extension.
+        // Answered from storage index while inotify watches every tier, so files added or removed by others are visible without touching disk.
+        bool hasFile(int64_t id, std::string_view extension = "");
+        // Must be called after file returned by resolvePath was written, so tier usage stays correct.
+        // Committed archive replaces previous one, so thumbnail and lite archive built from it are removed from disk and memory
+        void commitFile(int64_t id, const std::filesystem::path& path);
+
+        // Reads whole file into memory, returns empty string if file cannot be read
+        std::string readFile(const std::filesystem::path& path);
 
     }
 
@@ -0,0 +1,136 @@
+#include "thumbnailer.hh"
+
+#include "downloader.hh"
+#include "image.hh"
+#include "osu_file.hh"
+#include "storage_manager.hh"
+#include "utils.hh"
+
+#include <algorithm>
+#include <fstream>
+
+namespace detail {
+
+    uint32_t thumbnailWidth_ = 400;
+    int thumbnailQuality_ = 80;
+
+    // Returns empty string if beatmapset has no background and std::nullopt if background exists, but cannot be read
+    std::optional<std::string> generateThumbnail(const hanaru::Beatmap& beatmap) {
+        bool failed = false;
+
+        for (const hanaru::ZipEntry& entry : beatmap.entries()) {
+            if (!hanaru::osu_file::isOsuFile(entry.name)) {
+                continue;
+            }
+
+            const std::optional<std::string> osuFile = hanaru::zip::extract(beatmap.content(), entry);
+            if (!osuFile.has_value()) {
+                failed = true;
+                continue;
+            }
+
+            std::string background = hanaru::osu_file::findBackground(osuFile.value());
+            std::replace(background.begin(), background.end(), '\\', '/');
+
+            const hanaru::ZipEntry* backgroundEntry = beatmap.findEntry(background);
+            if (background.empty() || backgroundEntry == nullptr) {
+                continue;
+            }
+
+            const std::optional<std::string> image = hanaru::zip::extract(beatmap.content(), *backgroundEntry);
+            if (!image.has_value()) {
+                failed = true;
+                continue;
+            }
+
+            if (std::optional<std::string> thumbnail = hanaru::image::makeThumbnail(image.value(), thumbnailWidth_, thumbnailQuality_)) {
+                return thumbnail;
+            }
+
+            failed = true;
+        }
+
+        if (failed) {
+            return std::nullopt;
+        }
+
+        return std::string {};
+    }
+
+    void sendThumbnail(const std::shared_ptr<const std::string>& thumbnail, const std::function<void(std::tuple<drogon::HttpStatusCode, std::shared_ptr<const std::string>, std::string>&&)>& callback) {
+        if (thumbnail == nullptr || thumbnail->empty()) {
+            callback({ drogon::k404NotFound, nullptr, "beatmapset doesn't have background" });
+            return;
+        }
+
+        callback({ drogon::k200OK, thumbnail, "" });
+    }
+
+}
+
+namespace hanaru {
+
+    void thumbnailer::initialize(uint32_t width, int quality) {
+        if (width > 0) {
+            detail::thumbnailWidth_ = width;
+        }
+
+        if (quality > 0 && quality <= 100) {
+            detail::thumbnailQuality_ = quality;
+        }
+
+    }
+
+    void thumbnailer::getThumbnail(int64_t id, std::function<void(std::tuple<drogon::HttpStatusCode, std::shared_ptr<const std::string>, std::string>&&)>&& callback) {
+        if (!verifyRateLimit(1)) {
+            callback({ drogon::k429TooManyRequests, nullptr, "rate limit, please try again" });
+            return;
+        }
+
+        if (auto thumbnail = storage::findThumbnail(id)) {
+            detail::sendThumbnail(thumbnail, callback);
+            return;
+        }
+
+        const std::filesystem::path thumbnailPath = storage::resolvePath(id, ".jpg");
+
+        // Decoding and encoding images is too heavy to be done inside of event loop
+        storage::runTask([id, thumbnailPath, callback = std::move(callback)]() mutable {
+            if (storage::hasFile(id, ".jpg")) {
+                detail::sendThumbnail(storage::insertThumbnail(id, storage::readFile(thumbnailPath)), callback);
+                return;
+            }
+
+            downloader::downloadMap(id, [id, thumbnailPath, callback = std::move(callback)](std::tuple<drogon::HttpStatusCode, std::shared_ptr<const Beatmap>, std::string>&& result) mutable {
+                auto& [code, beatmap, error] = result;
+
+                if (beatmap == nullptr) {
+                    callback({ code, nullptr, std::move(error) });
+                    return;
+                }
+
+                storage::runTask([id, thumbnailPath, beatmap = std::move(beatmap), callback = std::move(callback)]() {
+                    std::optional<std::string> thumbnail = detail::generateThumbnail(*beatmap);
+
+                    // Not stored, so it's generated again once decoder is able to read background
+                    if (!thumbnail.has_value()) {
+                        callback({ drogon::k422UnprocessableEntity, nullptr, "background of beatmapset cannot be decoded" });
+                        return;
+                    }
+
+                    // Empty file is stored as well, so beatmapsets without background aren't loaded again
+                    if (storage::canWrite()) {
+                        std::ofstream thumbnailFile { thumbnailPath, std::ios::binary };
+                        thumbnailFile << thumbnail.value();
+
+                        thumbnailFile.close();
+                        storage::commitFile(id, thumbnailPath);
+                    }
+
+                    detail::sendThumbnail(storage::insertThumbnail(id, std::move(thumbnail.value())), callback);
+                });
+            });
+        });
+    }
+
+}
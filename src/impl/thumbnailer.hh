@@ -0,0 +1,23 @@
+#pragma once
+
+#include <drogon/HttpAppFramework.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <tuple>
+
+namespace hanaru {
+
+    namespace thumbnailer {
+
+        void initialize(uint32_t width, int quality);
+
+        // Returns thumbnail of beatmapset background as JPEG.
+        // Thumbnails are generated once from archive and stored next to it, so next requests are served from disk or memory.
+        // On success thumbnail is not null, otherwise string contains reason of failure
+        void getThumbnail(int64_t id, std::function<void(std::tuple<drogon::HttpStatusCode, std::shared_ptr<const std::string>, std::string>&&)>&& callback);
+
+    }
+
+}
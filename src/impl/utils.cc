@@ -77,4 +77,14 @@ namespace hanaru {
         return false;
     }
 
+    uint64_t remainingRateLimit() {
+        using namespace std::chrono;
+
+        uint64_t now = static_cast<uint64_t>(duration_cast<microseconds>(system_clock::now().time_since_epoch()).count());
+        uint64_t burstTime = now - bucketSize;
+        uint64_t point = std::max(bucketTime.load(std::memory_order_relaxed), burstTime);
+
+        return point >= now ? 0 : (now - point) / bucketRate;
+    }
+
 }
@@ -7,10 +7,25 @@
 
 namespace hanaru {
 
+    // Values of `approved` field from osu! API
+    enum class RankedStatus : int32_t {
+        // Not provided by osu!, used when status of archive is not known yet
+        Unknown = -3,
+        Graveyard = -2,
+        WorkInProgress = -1,
+        Pending = 0,
+        Ranked = 1,
+        Approved = 2,
+        Qualified = 3,
+        Loved = 4
+    };
+
     int64_t timeFromEpoch();
     int64_t stringToTime(Json::Value time);
     std::string timeToString(int64_t time);
 
     bool verifyRateLimit(uint64_t tokens);
+    // Tokens that can be taken from rate limit right now, without taking them
+    uint64_t remainingRateLimit();
 
 }
\ No newline at end of file
@@ -0,0 +1,254 @@
+#include "zip.hh"
+
+#include <zlib.h>
+
+namespace detail {
+
+    constexpr uint32_t zipLocalHeaderSignature = 0x04034b50;
+    constexpr uint32_t zipCentralHeaderSignature = 0x02014b50;
+    constexpr uint32_t zipEndOfDirectorySignature = 0x06054b50;
+
+    constexpr size_t zipLocalHeaderSize = 30;
+    constexpr size_t zipCentralHeaderSize = 46;
+    constexpr size_t zipEndOfDirectorySize = 22;
+    // End of central directory can be followed by comment with up to 65535 bytes
+    constexpr size_t zipMaxCommentSize = 0xFFFF;
+
+    // Uncompressed size is taken from untrusted header, so memory for it is allocated only if it's possible at all.
+    // Deflate cannot compress better than 1032:1, and nothing in osu! archive is bigger than whole archive might be
+    constexpr uint64_t deflateMaxRatio = 1032;
+    constexpr uint64_t maxExtractedSize = 256 * 1024 * 1024;
+
+    uint16_t readLE16(std::string_view data, size_t offset) {
+        return static_cast<uint16_t>(
+            static_cast<uint8_t>(data[offset]) |
+            static_cast<uint8_t>(data[offset + 1]) << 8
+        );
+    }
+
+    uint32_t readLE32(std::string_view data, size_t offset) {
+        return static_cast<uint32_t>(readLE16(data, offset)) | static_cast<uint32_t>(readLE16(data, offset + 2)) << 16;
+    }
+
+    void writeLE16(std::string& data, uint16_t value) {
+        data.push_back(static_cast<char>(value & 0xFF));
+        data.push_back(static_cast<char>((value >> 8) & 0xFF));
+    }
+
+    void writeLE32(std::string& data, uint32_t value) {
+        writeLE16(data, static_cast<uint16_t>(value & 0xFFFF));
+        writeLE16(data, static_cast<uint16_t>(value >> 16));
+    }
+
+    // Fields that are shared between local and central headers, starting from `version needed to extract`
+    void writeCommonHeader(std::string& data, const hanaru::ZipEntry& entry) {
+        // Sizes and CRC32 are always written into header, so data descriptor flag must be dropped
+        constexpr uint16_t dataDescriptorFlag = 0x8;
+
+        writeLE16(data, 20);
+        writeLE16(data, entry.flags & ~dataDescriptorFlag);
+        writeLE16(data, static_cast<uint16_t>(entry.method));
+        writeLE16(data, entry.modifiedTime);
+        writeLE16(data, entry.modifiedDate);
+        writeLE32(data, entry.crc32);
+        writeLE32(data, entry.compressedSize);
+        writeLE32(data, entry.uncompressedSize);
+        writeLE16(data, static_cast<uint16_t>(entry.name.size()));
+        // Extra field length
+        writeLE16(data, 0);
+    }
+
+}
+
+namespace hanaru {
+
+    std::vector<ZipEntry> zip::readCentralDirectory(std::string_view archive) {
+        if (archive.size() < detail::zipEndOfDirectorySize) {
+            return {};
+        }
+
+        // Searching for end of central directory from the end, because of optional comment
+        const size_t lowerBound = archive.size() > detail::zipEndOfDirectorySize + detail::zipMaxCommentSize
+            ? archive.size() - detail::zipEndOfDirectorySize - detail::zipMaxCommentSize
+            : 0;
+
+        size_t eocd = std::string_view::npos;
+        for (size_t i = archive.size() - detail::zipEndOfDirectorySize + 1; i-- > lowerBound;) {
+            if (detail::readLE32(archive, i) == detail::zipEndOfDirectorySignature) {
+                eocd = i;
+                break;
+            }
+        }
+
+        if (eocd == std::string_view::npos) {
+            return {};
+        }
+
+        const uint16_t totalEntries = detail::readLE16(archive, eocd + 10);
+        const uint32_t directoryOffset = detail::readLE32(archive, eocd + 16);
+
+        std::vector<ZipEntry> entries {};
+        entries.reserve(totalEntries);
+
+        size_t offset = directoryOffset;
+        for (uint16_t i = 0; i < totalEntries; i++) {
+            if (offset + detail::zipCentralHeaderSize > eocd || detail::readLE32(archive, offset) != detail::zipCentralHeaderSignature) {
+                return {};
+            }
+
+            const uint16_t flags = detail::readLE16(archive, offset + 8);
+            const uint16_t method = detail::readLE16(archive, offset + 10);
+            const uint16_t nameLength = detail::readLE16(archive, offset + 28);
+            const uint16_t extraLength = detail::readLE16(archive, offset + 30);
+            const uint16_t commentLength = detail::readLE16(archive, offset + 32);
+            const uint32_t localHeaderOffset = detail::readLE32(archive, offset + 42);
+
+            if (offset + detail::zipCentralHeaderSize + nameLength > eocd) {
+                return {};
+            }
+
+            ZipEntry entry {};
+            entry.name = archive.substr(offset + detail::zipCentralHeaderSize, nameLength);
+            entry.method = static_cast<ZipEntry::Method>(method);
+            entry.flags = flags;
+            entry.modifiedTime = detail::readLE16(archive, offset + 12);
+            entry.modifiedDate = detail::readLE16(archive, offset + 14);
+            entry.crc32 = detail::readLE32(archive, offset + 16);
+            entry.compressedSize = detail::readLE32(archive, offset + 20);
+            entry.uncompressedSize = detail::readLE32(archive, offset + 24);
+
+            offset += detail::zipCentralHeaderSize + nameLength + extraLength + commentLength;
+
+            // Encrypted entries, directories and unknown compression methods cannot be served anyway
+            const bool encrypted = flags & 0x1;
+            const bool directory = !entry.name.empty() && entry.name.back() == '/';
+            if (encrypted || directory || (entry.method != ZipEntry::Method::Stored && entry.method != ZipEntry::Method::Deflated)) {
+                continue;
+            }
+
+            // Local header might contain different extra field, so data offset must be taken from it
+            if (localHeaderOffset + detail::zipLocalHeaderSize > archive.size() || detail::readLE32(archive, localHeaderOffset) != detail::zipLocalHeaderSignature) {
+                continue;
+            }
+
+            const uint16_t localNameLength = detail::readLE16(archive, localHeaderOffset + 26);
+            const uint16_t localExtraLength = detail::readLE16(archive, localHeaderOffset + 28);
+            const uint64_t dataOffset = static_cast<uint64_t>(localHeaderOffset) + detail::zipLocalHeaderSize + localNameLength + localExtraLength;
+
+            if (dataOffset + entry.compressedSize > archive.size()) {
+                continue;
+            }
+
+            entry.dataOffset = static_cast<uint32_t>(dataOffset);
+            entries.push_back(std::move(entry));
+        }
+
+        return entries;
+    }
+
+    std::string_view zip::rawData(std::string_view archive, const ZipEntry& entry) {
+        return archive.substr(entry.dataOffset, entry.compressedSize);
+    }
+
+    std::optional<std::string> zip::extract(std::string_view archive, const ZipEntry& entry) {
+        const std::string_view data = rawData(archive, entry);
+        std::string result {};
+
+        if (entry.method == ZipEntry::Method::Stored) {
+            result = data;
+        }
+        else {
+            if (entry.uncompressedSize > detail::maxExtractedSize || entry.uncompressedSize > static_cast<uint64_t>(data.size()) * detail::deflateMaxRatio) {
+                return std::nullopt;
+            }
+
+            result.resize(entry.uncompressedSize);
+
+            z_stream stream {};
+            stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data.data()));
+            stream.avail_in = static_cast<uInt>(data.size());
+            stream.next_out = reinterpret_cast<Bytef*>(result.data());
+            stream.avail_out = static_cast<uInt>(result.size());
+
+            // Negative window bits means raw deflate stream without zlib header
+            if (inflateInit2(&stream, -MAX_WBITS) != Z_OK) {
+                return std::nullopt;
+            }
+
+            const int status = inflate(&stream, Z_FINISH);
+            const uLong written = stream.total_out;
+            inflateEnd(&stream);
+
+            if (status != Z_STREAM_END || written != entry.uncompressedSize) {
+                return std::nullopt;
+            }
+        }
+
+        const uLong crc = crc32(0L, reinterpret_cast<const Bytef*>(result.data()), static_cast<uInt>(result.size()));
+        if (crc != entry.crc32) {
+            return std::nullopt;
+        }
+
+        return result;
+    }
+
+    std::string zip::toGzip(std::string_view archive, const ZipEntry& entry) {
+        // https://www.rfc-editor.org/rfc/rfc1952#section-2.3
+        static constexpr char header[] = { '\x1f', '\x8b', '\x08', '\x00', '\x00', '\x00', '\x00', '\x00', '\x00', '\xff' };
+        const std::string_view data = rawData(archive, entry);
+
+        std::string result {};
+        result.reserve(sizeof(header) + data.size() + 8);
+        result.append(header, sizeof(header));
+        result.append(data);
+        detail::writeLE32(result, entry.crc32);
+        detail::writeLE32(result, entry.uncompressedSize);
+
+        return result;
+    }
+
+    std::string zip::repack(std::string_view archive, const std::vector<ZipEntry>& entries) {
+        std::string result {};
+        std::string directory {};
+        std::vector<uint32_t> offsets {};
+        offsets.reserve(entries.size());
+
+        for (const ZipEntry& entry : entries) {
+            offsets.push_back(static_cast<uint32_t>(result.size()));
+
+            detail::writeLE32(result, detail::zipLocalHeaderSignature);
+            detail::writeCommonHeader(result, entry);
+            result.append(entry.name);
+            result.append(rawData(archive, entry));
+        }
+
+        for (size_t i = 0; i < entries.size(); i++) {
+            detail::writeLE32(directory, detail::zipCentralHeaderSignature);
+            // Version made by
+            detail::writeLE16(directory, 20);
+            detail::writeCommonHeader(directory, entries[i]);
+            // Comment length, disk number, internal and external attributes
+            detail::writeLE16(directory, 0);
+            detail::writeLE16(directory, 0);
+            detail::writeLE16(directory, 0);
+            detail::writeLE32(directory, 0);
+            detail::writeLE32(directory, offsets[i]);
+            directory.append(entries[i].name);
+        }
+
+        const uint32_t directoryOffset = static_cast<uint32_t>(result.size());
+        result.append(directory);
+
+        detail::writeLE32(result, detail::zipEndOfDirectorySignature);
+        detail::writeLE16(result, 0);
+        detail::writeLE16(result, 0);
+        detail::writeLE16(result, static_cast<uint16_t>(entries.size()));
+        detail::writeLE16(result, static_cast<uint16_t>(entries.size()));
+        detail::writeLE32(result, static_cast<uint32_t>(directory.size()));
+        detail::writeLE32(result, directoryOffset);
+        detail::writeLE16(result, 0);
+
+        return result;
+    }
+
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace hanaru {
+
+    // Single record of zip central directory.
+    // Offsets are relative to the beginning of archive.
+    class ZipEntry {
+    public:
+        enum class Method : uint16_t {
+            Stored = 0,
+            Deflated = 8
+        };
+
+        std::string name {};
+        Method method = Method::Stored;
+        uint16_t flags = 0;
+        uint16_t modifiedTime = 0;
+        uint16_t modifiedDate = 0;
+        uint32_t crc32 = 0;
+        uint32_t compressedSize = 0;
+        uint32_t uncompressedSize = 0;
+        uint32_t dataOffset = 0;
+    };
+
+    namespace zip {
+
+        // Reads central directory of archive.
+        // Returns empty vector if archive is malformed, entries with unsupported compression are skipped.
+        std::vector<ZipEntry> readCentralDirectory(std::string_view archive);
+
+        // Returns compressed bytes of entry exactly as they stored in archive.
+        std::string_view rawData(std::string_view archive, const ZipEntry& entry);
+
+        // Decompresses entry, CRC32 is verified.
+        // Returns std::nullopt if entry is corrupted or its declared size cannot be real (or exceeds 256 MB).
+        std::optional<std::string> extract(std::string_view archive, const ZipEntry& entry);
+
+        // Wraps deflate stream of entry into gzip member without recompressing it.
+        // Only valid for entries with Method::Deflated.
+        std::string toGzip(std::string_view archive, const ZipEntry& entry);
+
+        // Builds new archive from provided entries of existing one, compressed data is copied as is.
+        std::string repack(std::string_view archive, const std::vector<ZipEntry>& entries);
+
+    }
+
+}
@@ -1,9 +1,17 @@
 #include <drogon/drogon.h>
 
+#include "impl/cancellation.hh"
+#include "impl/crawler.hh"
 #include "impl/downloader.hh"
+#include "impl/prefetcher.hh"
+#include "impl/refresher.hh"
+#include "impl/revalidator.hh"
+#include "impl/scheduler.hh"
+#include "impl/thumbnailer.hh"
 #include "impl/utils.hh"
 #include "impl/storage_manager.hh"
 
+#include <algorithm>
 #include <fstream>
 
 drogon::HttpResponsePtr errorHandler(drogon::HttpStatusCode code) {
@@ -50,13 +58,87 @@ int main() {
 
     Json::Value customConfig = drogon::app().getCustomConfig();
 
-    hanaru::downloader::initialize(customConfig["osu_api_key"].asString(), customConfig["osu_username"].asString(), customConfig["osu_password"].asString());
-    hanaru::storage::initialize(customConfig["beatmaps_path"].asString(), customConfig["required_free_space"].asUInt64());
+    const Json::Value& upstreamConcurrency = customConfig["upstream_concurrency"];
+    hanaru::scheduler::initialize(
+        upstreamConcurrency["interactive"].asUInt64(),
+        upstreamConcurrency["background"].asUInt64(),
+        upstreamConcurrency["bulk"].asUInt64(),
+        customConfig["upstream_max_wait"].asUInt64()
+    );
+
+    // Single account from `osu_username` and `osu_password` is still supported
+    std::vector<hanaru::Credentials> accounts { { customConfig["osu_username"].asString(), customConfig["osu_password"].asString() } };
+    for (const Json::Value& account : customConfig["osu_accounts"]) {
+        accounts.push_back({ account["username"].asString(), account["password"].asString() });
+    }
+
+    // Single key from `osu_api_key` is still supported
+    std::vector<std::string> apiKeys { customConfig["osu_api_key"].asString() };
+    for (const Json::Value& apiKey : customConfig["osu_api_keys"]) {
+        // Same key in both options would be counted twice, while osu! limits it once
+        if (std::find(apiKeys.begin(), apiKeys.end(), apiKey.asString()) == apiKeys.end()) {
+            apiKeys.push_back(apiKey.asString());
+        }
+    }
+
+    std::vector<std::string> mirrors {};
+    for (const Json::Value& mirror : customConfig["mirrors"]) {
+        mirrors.push_back(mirror.asString());
+    }
+
+    const Json::Value& circuitBreaker = customConfig["circuit_breaker"];
+    hanaru::downloader::initialize(
+        apiKeys,
+        accounts,
+        customConfig["session_budget"].asUInt64(),
+        circuitBreaker["failure_threshold"].asUInt64(),
+        circuitBreaker["base_backoff"].asUInt64(),
+        circuitBreaker["max_backoff"].asUInt64(),
+        mirrors,
+        customConfig["hedge_delay"].asDouble(),
+        customConfig["api_pipelining_depth"].asUInt64()
+    );
 
-    if (!std::filesystem::exists(hanaru::storage::getBeatmapsPath())) {
-        std::filesystem::create_directory(hanaru::storage::getBeatmapsPath());
+    const Json::Value& deadlines = customConfig["deadlines"];
+    hanaru::deadlines::initialize(deadlines["lookup"].asUInt64(), deadlines["download"].asUInt64());
+
+    std::vector<hanaru::StorageTier> storageTiers {};
+    for (const Json::Value& tier : customConfig["storage_tiers"]) {
+        storageTiers.push_back({ tier["path"].asString(), tier["capacity"].asUInt64() });
+    }
+
+    // Single tier without capacity limit behaves exactly as plain `beatmaps_path`
+    if (storageTiers.empty()) {
+        storageTiers.push_back({ customConfig["beatmaps_path"].asString(), 0 });
     }
 
+    hanaru::storage::initialize(std::move(storageTiers), customConfig["required_free_space"].asUInt64(), customConfig["tiering_interval"].asUInt64());
+    hanaru::thumbnailer::initialize(customConfig["thumbnail_width"].asUInt(), customConfig["thumbnail_quality"].asInt());
+    hanaru::revalidator::initialize(customConfig["revalidation_interval"].asUInt64(), customConfig["revalidation_cooldown"].asUInt64(), customConfig["revalidation_batch_size"].asUInt64());
+    hanaru::prefetcher::initialize(
+        customConfig["prefetch_interval"].asUInt64(),
+        customConfig["prefetch_batch_size"].asUInt64(),
+        customConfig["prefetch_max_speed"].asUInt64(),
+        customConfig["prefetch_max_age"].asUInt64()
+    );
+
+    const Json::Value& speculativePrefetch = customConfig["speculative_prefetch"];
+    hanaru::prefetcher::initializeSpeculative(
+        speculativePrefetch["window"].asUInt64(),
+        speculativePrefetch["min_conversion"].asDouble(),
+        speculativePrefetch["reserved_tokens"].asUInt64()
+    );
+    hanaru::crawler::initialize(customConfig["crawler_interval"].asUInt64(), customConfig["crawler_page_size"].asUInt64());
+
+    const Json::Value& refreshCooldowns = customConfig["refresh_cooldowns"];
+    hanaru::refresher::initialize(
+        customConfig["refresh_interval"].asUInt64(),
+        customConfig["refresh_batch_size"].asUInt64(),
+        refreshCooldowns["qualified"].asUInt64(),
+        refreshCooldowns["loved"].asUInt64(),
+        refreshCooldowns["pending"].asUInt64()
+    );
+
     drogon::app().run();
 
     return 0;
@@ -3,6 +3,7 @@
 
 #include <list>
 #include <memory>
+#include <mutex>
 #include <shared_mutex>
 #include <unordered_map>
 
@@ -33,6 +34,8 @@ namespace cache {
         CapacityT capacity() const noexcept;
 
         SharedValueT pop();
+        // Returns true if key was present
+        bool erase(const KeyT& key);
         void clear();
 
     private:
@@ -52,6 +55,7 @@ namespace cache {
         if (cache_.find(key) == cache_.end()) {
             if (cache_.size() + 1 > SIZE) {
                 cache_.erase(lruQueue_.back());
+                keys_.erase(lruQueue_.back());
                 lruQueue_.pop_back();
             }
 
@@ -73,6 +77,7 @@ namespace cache {
         if (cache_.find(key) == cache_.end()) {
             if (cache_.size() + 1 > SIZE) {
                 cache_.erase(lruQueue_.back());
+                keys_.erase(lruQueue_.back());
                 lruQueue_.pop_back();
             }
 
@@ -94,6 +99,7 @@ namespace cache {
         if (cache_.find(key) == cache_.end()) {
             if (cache_.size() + 1 > SIZE) {
                 cache_.erase(lruQueue_.back());
+                keys_.erase(lruQueue_.back());
                 lruQueue_.pop_back();
             }
 
@@ -110,7 +116,8 @@ namespace cache {
 
     template <typename K, typename V, size_t SIZE>
     inline typename LRUCache<K, V, SIZE>::SharedValueT LRUCache<K, V, SIZE>::find(const KeyT& key) const {
-        std::shared_lock<std::shared_mutex> lock { mutex_ };
+        // Exclusive lock is required, because touch reorders LRU queue
+        std::unique_lock<std::shared_mutex> lock { mutex_ };
 
         auto it = cache_.find(key);
         if (it == cache_.end()) {
@@ -141,10 +148,26 @@ namespace cache {
         }
         
         auto it = cache_.extract(lruQueue_.back());
+        keys_.erase(lruQueue_.back());
         lruQueue_.pop_back();
         return it.mapped();
     }
 
+    template <typename K, typename V, size_t SIZE>
+    inline bool LRUCache<K, V, SIZE>::erase(const KeyT& key) {
+        std::unique_lock<std::shared_mutex> lock { mutex_ };
+
+        auto it = keys_.find(key);
+        if (it == keys_.end()) {
+            return false;
+        }
+
+        lruQueue_.erase(it->second);
+        keys_.erase(it);
+        cache_.erase(key);
+        return true;
+    }
+
     template <typename K, typename V, size_t SIZE>
     inline void LRUCache<K, V, SIZE>::clear() {
         std::unique_lock<std::shared_mutex> lock { mutex_ };
@@ -171,12 +171,6 @@ namespace detail {
         name = cookie.substr(cpos);
     }
 
-    size_t writeCallback(char* ptr, size_t size, size_t nmemb, void* userdata) {
-        const size_t res { size * nmemb };
-        static_cast<std::string*>(userdata)->append(ptr, res);
-        return res;
-    }
-
     size_t headerCallback(char* ptr, size_t size, size_t nmemb, void* userdata) {
         const size_t res = size * nmemb;
         const std::string header { ptr, res };
@@ -479,8 +473,15 @@ namespace curl {
         followRedirects_ = true;
         saveCookiesInHeaders_ = false;
 
+        timeout_ = -1;
+        maxDownloadSpeed_ = 0;
+        lowSpeedLimit_ = 0;
+        lowSpeedTime_ = 0;
+        cancellationToken_.reset();
+
         preRequestCallback_ = nullptr;
         postRequestCallback_ = nullptr;
+        dataHandler_ = nullptr;
         onErrorHandler_ = nullptr;
         onExceptionHandler_ = nullptr;
         finalHandler_ = nullptr;
@@ -619,6 +620,27 @@ namespace curl {
         return *this;
     }
 
+    Factory::Builder& Factory::Builder::setTimeout(long milliseconds) noexcept {
+        timeout_ = milliseconds > 0 ? milliseconds : 0;
+        return *this;
+    }
+
+    Factory::Builder& Factory::Builder::setMaxDownloadSpeed(uint64_t bytesPerSecond) noexcept {
+        maxDownloadSpeed_ = bytesPerSecond;
+        return *this;
+    }
+
+    Factory::Builder& Factory::Builder::setLowSpeedLimit(uint64_t bytesPerSecond, long seconds) noexcept {
+        lowSpeedLimit_ = seconds > 0 ? bytesPerSecond : 0;
+        lowSpeedTime_ = seconds > 0 ? seconds : 0;
+        return *this;
+    }
+
+    Factory::Builder& Factory::Builder::setCancellationToken(const std::shared_ptr<std::atomic_bool>& token) noexcept {
+        cancellationToken_ = token;
+        return *this;
+    }
+
     Factory::Builder& Factory::Builder::preRequest(preRequestHandler&& callback) noexcept {
         preRequestCallback_ = std::move(callback);
         return *this;
@@ -629,6 +651,11 @@ namespace curl {
         return *this;
     }
 
+    Factory::Builder& Factory::Builder::onData(dataHandler&& callback) noexcept {
+        dataHandler_ = std::move(callback);
+        return *this;
+    }
+
     Factory::Builder& Factory::Builder::onError(onErrorHandler&& callback) noexcept {
         onErrorHandler_ = std::move(callback);
         return *this;
@@ -647,6 +674,7 @@ namespace curl {
     Factory::Builder& Factory::Builder::resetCallbacks() noexcept {
         preRequestCallback_ = nullptr;
         postRequestCallback_ = nullptr;
+        dataHandler_ = nullptr;
         onErrorHandler_ = nullptr;
         onExceptionHandler_ = nullptr;
         finalHandler_ = nullptr;
@@ -824,10 +852,48 @@ namespace curl {
             curl_easy_cleanup(handle);
         }
 
+        static size_t writeCallback(char* ptr, size_t size, size_t nmemb, void* userdata) {
+            Client* client = static_cast<Client*>(userdata);
+            const size_t res { size * nmemb };
+
+            if (!client->dataHandler) {
+                client->response.body.append(ptr, res);
+                return res;
+            }
+
+            long sc = 0;
+            curl_easy_getinfo(client->handle, CURLINFO_RESPONSE_CODE, &sc);
+            client->response.code = sc;
+
+            try {
+                // Returning anything except amount of received bytes aborts transfer
+                return client->dataHandler(client->response, std::string_view { ptr, res }) ? res : 0;
+            }
+            catch (...) {
+                try {
+                    if (client->onExceptionHandler) {
+                        client->onExceptionHandler(ExceptionType::OnData, std::current_exception());
+                    }
+                }
+                catch (...) { /* ignored */ }
+
+                return 0;
+            }
+        }
+
+        static int progressCallback(void* userdata, curl_off_t, curl_off_t, curl_off_t, curl_off_t) {
+            Client* client = static_cast<Client*>(userdata);
+
+            // Returning non-zero value aborts transfer with CURLE_ABORTED_BY_CALLBACK
+            return client->cancellationToken && client->cancellationToken->load() ? 1 : 0;
+        }
+
         CURL* handle;
         struct curl_slist* headers = nullptr;
+        std::shared_ptr<std::atomic_bool> cancellationToken {};
 
         curl::Factory::postRequestHandler postRequestHandler = nullptr;
+        curl::Factory::dataHandler dataHandler = nullptr;
         curl::Factory::onErrorHandler onErrorHandler = nullptr;
         curl::Factory::onExceptionHandler onExceptionHandler = nullptr;
         curl::Factory::finalHandler finalHandler = nullptr;
@@ -886,6 +952,7 @@ namespace curl {
         }
 
         client->postRequestHandler = builder.postRequestCallback_;
+        client->dataHandler = builder.dataHandler_;
         client->onErrorHandler = builder.onErrorHandler_;
         client->onExceptionHandler = builder.onExceptionHandler_;
         client->finalHandler = builder.finalHandler_;
@@ -968,11 +1035,27 @@ namespace curl {
             curl_easy_setopt(client->handle, CURLOPT_FOLLOWLOCATION, 1L);
         }
 
-        curl_easy_setopt(client->handle, CURLOPT_WRITEFUNCTION, &detail::writeCallback);
-        curl_easy_setopt(client->handle, CURLOPT_WRITEDATA, &client->response.body);
+        curl_easy_setopt(client->handle, CURLOPT_WRITEFUNCTION, &Client::writeCallback);
+        curl_easy_setopt(client->handle, CURLOPT_WRITEDATA, client.get());
         curl_easy_setopt(client->handle, CURLOPT_HEADERFUNCTION, &detail::headerCallback);
         curl_easy_setopt(client->handle, CURLOPT_HEADERDATA, &client->response.headers);
-        curl_easy_setopt(client->handle, CURLOPT_TIMEOUT_MS, maxConnectionTimeout_);
+        curl_easy_setopt(client->handle, CURLOPT_TIMEOUT_MS, builder.timeout_ >= 0 ? builder.timeout_ : maxConnectionTimeout_);
+
+        if (builder.maxDownloadSpeed_ > 0) {
+            curl_easy_setopt(client->handle, CURLOPT_MAX_RECV_SPEED_LARGE, static_cast<curl_off_t>(builder.maxDownloadSpeed_));
+        }
+
+        if (builder.lowSpeedLimit_ > 0) {
+            curl_easy_setopt(client->handle, CURLOPT_LOW_SPEED_LIMIT, static_cast<long>(builder.lowSpeedLimit_));
+            curl_easy_setopt(client->handle, CURLOPT_LOW_SPEED_TIME, builder.lowSpeedTime_);
+        }
+
+        if (builder.cancellationToken_) {
+            client->cancellationToken = builder.cancellationToken_;
+            curl_easy_setopt(client->handle, CURLOPT_NOPROGRESS, 0L);
+            curl_easy_setopt(client->handle, CURLOPT_XFERINFOFUNCTION, &Client::progressCallback);
+            curl_easy_setopt(client->handle, CURLOPT_XFERINFODATA, client.get());
+        }
 
         switch (builder.type_) {
             default:
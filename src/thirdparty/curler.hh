@@ -29,8 +29,11 @@
 
 #include <atomic> // std::atomic_bool, std::atomic_size_t
 #include <condition_variable> // std::condition_variable, std::mutex
+#include <cstdint> // uint64_t
 #include <functional> // std::function
+#include <memory> // std::shared_ptr, std::unique_ptr
 #include <string> // std::string
+#include <string_view> // std::string_view
 #include <thread> // std::thread
 #include <unordered_map> // std::unordered_map, std::unordered_multimap
 
@@ -141,7 +144,8 @@ namespace curl {
     enum class ExceptionType : uint8_t {
         OnError = 0,
         OnPreRequest = 1,
-        OnPostRequest = 2
+        OnPostRequest = 2,
+        OnData = 3
     };
 
     // Class that represents a cookie information.
@@ -222,6 +226,7 @@ namespace curl {
 
         typedef std::function<void(const Builder&)> preRequestHandler;
         typedef std::function<void(Response&)> postRequestHandler;
+        typedef std::function<bool(Response&, std::string_view)> dataHandler;
         typedef std::function<void(Response&)> onErrorHandler;
         typedef std::function<void(ExceptionType, std::exception_ptr)> onExceptionHandler;
         typedef std::function<void()> finalHandler;
@@ -266,12 +271,26 @@ namespace curl {
             Builder& setUserAgent(const std::string& agent);
             Builder& followRedirects(bool state = true) noexcept;
             Builder& saveCookiesInHeaders(bool state = false) noexcept;
+            // Overrides timeout of factory for this request, 0 means no timeout.
+            Builder& setTimeout(long milliseconds) noexcept;
+            // Limits download speed of this request, 0 means no limit.
+            Builder& setMaxDownloadSpeed(uint64_t bytesPerSecond) noexcept;
+            // Transfer is aborted and onError is called if it was slower than given speed for given amount of seconds, 0 seconds means no limit.
+            // Unlike timeout, this doesn't limit large downloads that are progressing.
+            Builder& setLowSpeedLimit(uint64_t bytesPerSecond, long seconds) noexcept;
+            // Transfer is aborted and onError is called soon after token becomes true.
+            // Token can be set from any thread, it's checked by curl at least once per second.
+            Builder& setCancellationToken(const std::shared_ptr<std::atomic_bool>& token) noexcept;
 
             // Called before adding handle into query.
             // If this callback throws an exception, then whole request will be rejected immediately.
             Builder& preRequest(preRequestHandler&& callback) noexcept;
             // Called when request fully done, contains result of request.
             Builder& onComplete(postRequestHandler&& callback) noexcept;
+            // Called for every received chunk of body instead of collecting it into Response::body.
+            // Response already contains status code and headers of current response.
+            // If this callback returns false or throws an exception, then transfer will be aborted and onError will be called.
+            Builder& onData(dataHandler&& callback) noexcept;
             // Called when error happend inside curl and request cannot be fully performed.
             Builder& onError(onErrorHandler&& callback) noexcept;
             // Called when any of your callbacks (except final) throws exception.
@@ -298,8 +317,16 @@ namespace curl {
             bool followRedirects_ = true;
             bool saveCookiesInHeaders_ = false;
 
+            // Negative value means that timeout of factory is used
+            long timeout_ = -1;
+            uint64_t maxDownloadSpeed_ = 0;
+            uint64_t lowSpeedLimit_ = 0;
+            long lowSpeedTime_ = 0;
+            std::shared_ptr<std::atomic_bool> cancellationToken_ {};
+
             preRequestHandler preRequestCallback_ = nullptr;
             postRequestHandler postRequestCallback_ = nullptr;
+            dataHandler dataHandler_ = nullptr;
             onErrorHandler onErrorHandler_ = nullptr;
             onExceptionHandler onExceptionHandler_ = nullptr;
             finalHandler finalHandler_ = nullptr;